@@ -0,0 +1,54 @@
+/******************************************************************************
+
+    swmain - a research tool for minimizing maximal subword occurrences
+    
+    Copyright (C) 2024 Wenjie Fang <fwjmath@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+******************************************************************************/
+
+
+#ifndef __MAXOCC__
+#define __MAXOCC__
+
+/*
+Entry point of the library libmaxocc.
+
+All the state of a computation (binomial table, cache of subword counts,
+parallel mode) lives in a context created by sw_ctx_new and freed by
+sw_ctx_free. Every function of the library takes the context as its first
+argument, so that independent contexts (e.g., for different n, each with its
+own cache) can be used at the same time from different threads. A context in
+serial mode should only be used by one thread at a time, while a context in
+parallel mode (see set_parallel_mode) has a frozen cache shared by all.
+
+Main entry points, all returning structured results:
+- subword_cnt: number of occurrences of a subword in a word
+- canon_gen_new, canon_next: enumeration of words up to reversal and complement
+- maxfreq_subword_single: maxocc of a word, with its most frequent subwords
+- min_maxfreq_subword_hinted(_mt): exhaustive search of the minimal maxocc
+- maxfreq_subword_histo: histogram of maxocc of all words of a given length
+- maxfreq_subword_sample: estimation of the histogram by sampling
+- warm_cache_pairs: parallel fill of the cache before a frozen, parallel use
+- insert_heuristic_word, insert_beam, local_descent, mixed_descent,
+  simulated_annealing, tabu_search: heuristics for hints
+*/
+
+#include "swcnt.hpp"
+#include "swexhaust.hpp"
+#include "swmeta.hpp"
+#include "swutils.hpp"
+
+#endif
@@ -0,0 +1,137 @@
+/******************************************************************************
+
+    swmain - a research tool for minimizing maximal subword occurrences
+    
+    Copyright (C) 2024 Wenjie Fang <fwjmath@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+******************************************************************************/
+
+#ifndef __SWCLI__
+#define __SWCLI__
+
+/*
+Command line layer of swmain, on top of libmaxocc: the modes that print their
+results on stdout or read words from files. Not part of the library.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "swcnt.hpp"
+#include "swexhaust.hpp"
+#include "swutils.hpp"
+#include "swmeta.hpp"
+
+// number of words read at once in batch mode, results are written in order
+#define BATCH_CHUNK 4096
+
+// a chunk of words in batch mode, shared by the threads
+typedef struct {
+    int cnt;                   // number of lines in the chunk
+    long lines[BATCH_CHUNK];   // line numbers in the input
+    char valid[BATCH_CHUNK];   // whether the line is a valid word
+    Word words[BATCH_CHUNK];
+    Rec_sw recs[BATCH_CHUNK];
+} Batch_chunk;
+
+// thread information for batch mode
+typedef struct {
+    Sw_ctx* ctx;
+    int thread_id;
+    Batch_chunk* chunk;
+} Batch_info;
+
+// number of consecutive canonical words in a block of the tuning sample
+#define TUNE_BLOCK 64
+
+// the evaluation of the sample is repeated for at least this CPU time in a
+// trial, and the trials of a value are compared by their median
+#define TUNE_MIN_SECONDS 0.5
+#define TUNE_RUNS 3
+
+// exhaustive search for minimal subword entropy, using a hint
+// using subword with large number of occurrences from the last word as a hint
+void hinted_search(Sw_ctx* ctx, int n, u64 hint);
+
+// the parallel version of the function above, with a certificate of the
+// result written to the file at certpath if it is not NULL
+void hinted_search_parallel(Sw_ctx* ctx, int n, u64 hint, const char* certpath);
+
+// check the certificate of a parallel search, and print the lower bound that
+// it proves on the maxocc of words with n bits
+void verify_search(Sw_ctx* ctx, int n, const char* certpath);
+
+// build the table of maxocc of all the words of m bits, written to path
+// (ORACLE_FILE if NULL), to be used by the exhaustive search with MAXOCC_ORACLE
+void build_oracle(Sw_ctx* ctx, int m, const char* path);
+
+// build a histogram for subword occurrences
+void histo_subword(Sw_ctx* ctx, int n);
+
+// estimate the histogram for subword occurrences by sampling, see
+// maxfreq_subword_sample for the stopping conditions
+void sample_histo_subword(Sw_ctx* ctx, int n, u64 seed, double precision, double seconds);
+
+// print record
+void print_record(Rec_sw* minrec);
+
+// printing the word in binary
+void print_word_bin(Word word);
+
+// debug purpose
+void print_word(Word* word);
+
+// compute the most frequent subwords of a given word
+void compute_maxfreq_subword(Sw_ctx* ctx, char* wstr);
+
+// compute the most frequent subwords of words with n bits, one 0-1 string per
+// line read from in, in parallel. Results are written to out in JSONL, in the
+// same order as the input
+void batch_maxfreq_subword(Sw_ctx* ctx, int n, FILE* in, FILE* out);
+
+// print the result of the beam search from the given 0-1 strings, the number
+// of rounds is the number of bits n minus their length
+void insert_beam_search(Sw_ctx* ctx, int n, int beam, char** wstrs, int cnt);
+
+// exhaustive searches for n from nmin to nmax in one process, keeping the
+// cache. The hint for n is the best exact maxocc of the words obtained by
+// inserting a letter in the optimal words for n - 1 (see insert_beam), the
+// first hint is given. The results for each n are written to out as soon as they are found,
+// one JSON object per line
+void campaign(Sw_ctx* ctx, int nmin, int nmax, u64 hint, FILE* out);
+
+// time the exhaustive search on blocks of consecutive canonical words with n
+// bits, drawn with a fixed seed, for several values of each parameter in turn,
+// and save the fastest ones as the profile for n in the file at path, unless
+// none beats the defaults beyond the noise of the timings. The record is the
+// hint, or the best maxocc of the sample if the hint is 0
+void autotune(Sw_ctx* ctx, int n, int blocks, u64 hint, const char* path);
+
+// compare all the counting engines on random pairs of a word with n bits and
+// a subword with the same ends, drawn with the seed, print the mismatches and
+// the time of each engine by length of the subword. The cache of the context
+// should be empty, so that it does not help the recursive engine
+void engines_check(Sw_ctx* ctx, int n, int pairs, u64 seed);
+
+// adds a letter somewhere in a hinted word (previous record)
+// computation is heuristic, not complete (fast variant)
+void insert_heuristic(Sw_ctx* ctx, char* wstr);
+
+// run each engine with the same budget on the given seeds, and print the best
+// maxocc found against CPU time
+void meta_compare(Sw_ctx* ctx, int n, double seconds, int seedcnt);
+
+#endif
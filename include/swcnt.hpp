@@ -29,16 +29,29 @@
 #include <vector>
 #include <bit>
 #include <utility>
+#include <atomic>
+#include <mutex>
+#include <sched.h>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
 
 #define MAXLEN 64
-#define MAX_CACHE_RUN 9
+#define MAX_CACHE_RUN 9 // default, may be changed by a tuning profile
+#define L1_CACHE_BITS 14 // 2^14 entries of 32 bytes per thread, fits in L2
+#define BITDP_MAXLEN 0 // letter DP up to this length by default, i.e., never
+#define RUNDP_SLACKPCT 40 // run DP if the runs of w unused by the subword are
+                          // more than this percentage of the runs of the subword
+#define CACHE_ENTRY_BYTES 56 // estimated memory of an entry of Cache, with its bucket
+#define REPLICA_MAX_NODES 16 // NUMA nodes with a replica of the frozen cache
+#define TT_BITS 20 // 2^20 entries of 16 bytes in the transposition table
+#define TT_MAXLEN 58 // longer words are not in the transposition table
+#define ORACLE_MAXLEN 28 // longest words in the table of maxocc, 256MB
 
 typedef uint64_t u64;
 
 typedef std::pair<u64, u64> u64pair;
 
-typedef int Runtab[MAXLEN];
-
 struct pairhash {
     public:
     template <typename T, typename U>
@@ -49,15 +62,166 @@ struct pairhash {
 
 typedef std::unordered_map<u64pair, u64, pairhash> Cache; // Cache for subword counting
 
+// entry of the per-thread first-level cache, direct-mapped, in front of Cache
+// subword counts do not depend on the context, so it is shared by all contexts
+typedef struct {
+    u64 wbits;
+    u64 swbits;
+    u64 cnt;
+    int lens; // (word length << 8) + subword length, 0 for empty entries
+} L1_entry;
+
+// entry of a replica of the frozen cache, lens as in L1_entry, 0 if empty
+typedef struct {
+    u64 wbits;
+    u64 swbits;
+    u64 cnt;
+    u64 lens;
+} Replica_entry;
+
+// read-only copy of the frozen cache in the memory of a NUMA node, as an
+// open-addressing table with linear probing, on huge pages if possible
+typedef struct {
+    Replica_entry* slots;
+    u64 mask;
+    size_t bytes;
+    int node;
+    cpu_set_t cpus; // of the node, for the threads using this replica
+} Cache_replica;
+
+// entry of the transposition table of the metaheuristics, direct-mapped, with
+// bounds on the fast maxocc of words up to reversal and complement, as pruned
+// evaluations are not exact. The key is xored with the data, so that an
+// entry torn by concurrent writes is seen as a miss
+typedef struct {
+    std::atomic<u64> check; // key ^ data, the key is (len << 57) + canonical bits
+    std::atomic<u64> data;  // (bound << 2) + 1 if lower, + 2 if upper, + 3 if exact
+} Tt_entry;
+
+// all the state of a computation, several contexts can be used at the same time
+typedef struct {
+    u64 binom[MAXLEN][MAXLEN]; // precomputed binomial coefficients
+    Cache swcnt[MAXLEN][MAXLEN]; // indices are #bits
+    u64 parallel_mask; // -1 by default means serial mode. 0 means parallel mode
+    u64 cache_budget; // memory for the cache in bytes, 0 for no limit
+    u64 cache_entries; // number of entries in the cache
+    int cache_min_score; // only entries with at least this score are admitted
+    int warm_len; // the warm-up of the cache was done up to this length
+    int warm_maxlen; // length up to which the warm-up goes, 0 for automatic
+    int max_cache_run; // only words with fewer runs are cached
+    int insert_margin; // serial mode: pieces longer than the word minus this
+                       // margin are computed but not inserted in the cache
+    int bitdp_maxlen; // words up to this length are counted by the letter DP
+    int rundp_slackpct; // longer words by the run DP if the runs of w unused
+                        // by the subword are more than this percentage of the
+                        // runs of the subword, otherwise by the cached
+                        // recursion; -1 for the run DP only
+    int search_threads; // threads scanning the neighborhoods of local search,
+                        // only used if the cache is frozen (parallel mode)
+    bool deterministic; // parallel scans give the result of the sequential one
+    FILE* log; // where progress messages go, NULL for none
+    std::atomic<u64> l1_lookups; // statistics of the first-level caches,
+    std::atomic<u64> l1_hits;    // collected from the threads
+    Cache_replica* replicas; // copies of the frozen cache, one per NUMA node
+    int replica_cnt;         // 0 if the cache is not replicated
+    u64 serial; // distinct for each context created, keys the copy of a thread
+    Tt_entry* ttable; // transposition table, allocated when first used
+    std::once_flag tt_once; // by a single thread, the others wait for it
+    std::atomic<u64> tt_lookups; // statistics of the transposition table, a hit
+    std::atomic<u64> tt_hits;    // is a lookup saving an evaluation
+    const uint16_t* oracle; // maxocc of the words of oracle_len bits, NULL if
+    int oracle_len;         // none, see oracle_load
+    void* oracle_map;       // the mapped file, with its header
+    size_t oracle_bytes;
+    std::atomic<u64> oracle_pruned; // words pruned by the table in searches
+    std::atomic<u64> live_record; // record of the running exhaustive search,
+                                  // shared by its threads
+    const char* hint_file; // polled during exhaustive searches for a better
+                           // hint, lowering live_record, NULL for none
+} Sw_ctx;
+
 typedef struct{
     u64 bits;
-    int* run;  // run lengths from left to right, leftmost run always contains 0
-               // should not use this field outside the called function
-               // as most of the time it will be local variables
+    u64 bound; // run boundaries: bit i is set if a run starts at bit i, i.e.,
+               // if bit i differs from bit i + 1, and bit len - 1 is always set
+               // the runs are thus read with pext/pdep instead of a table
     int runcnt;
     int len;   // number of bits
 } Word;
 
+// mask of the k lowest bits, also valid for k = 64
+static inline u64 low_mask(int k){
+#ifdef __BMI2__
+    return _bzhi_u64(~0ULL, k);
+#else
+    return k >= 64 ? ~0ULL : (1ULL << k) - 1;
+#endif
+}
+
+// position of the r-th lowest set bit of x, r should be smaller than popcount
+static inline int select_bit(u64 x, int r){
+#ifdef __BMI2__
+    return std::countr_zero(_pdep_u64(1ULL << r, x));
+#else
+    for(int i = 0; i < r; i++) x &= x - 1;
+    return std::countr_zero(x);
+#endif
+}
+
+// spread the lowest bits of x on the set bits of mask, in order
+static inline u64 deposit_bits(u64 x, u64 mask){
+#ifdef __BMI2__
+    return _pdep_u64(x, mask);
+#else
+    u64 res = 0;
+    for(u64 bit = 1; mask; bit <<= 1){
+        if(x & bit) res |= mask & -mask;
+        mask &= mask - 1;
+    }
+    return res;
+#endif
+}
+
+// reverse the len lowest bits of x
+static inline u64 reverse_bits(u64 x, int len){
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    x = __builtin_bswap64(x);
+    return x >> (64 - len);
+}
+
+// seeded pseudo-random generator (splitmix64), for reproducible runs
+static inline u64 random_next(u64* state){
+    u64 z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// representative of the class of a word under reversal and complement, i.e.,
+// the smallest one, which starts with 0
+static inline u64 canonical_bits(u64 bits, int len){
+    if(bits >> (len - 1)) bits ^= low_mask(len);
+    u64 rev = reverse_bits(bits, len);
+    if(bits & 1) rev ^= low_mask(len);
+    return bits < rev ? bits : rev;
+}
+
+// position of the highest bit of the run with index idx (from left to right)
+// returns -1 for idx == runcnt, i.e., the position just after the last run
+static inline int word_run_top(Word w, int idx){
+    int r = w.runcnt - 1 - idx;
+    return r < 0 ? -1 : select_bit(w.bound, r);
+}
+
+// length of the run with index idx (from left to right)
+static inline int word_run(Word w, int idx){
+    int top = word_run_top(w, idx);
+    // next boundary to the right, countl_zero(0) = 64 gives -1 as wanted
+    return top - (63 - std::countl_zero(w.bound & low_mask(top)));
+}
+
 // record for subword occurrences of a given word
 typedef struct {
     Word word;
@@ -70,20 +234,37 @@ typedef struct {
     u64 occ;
 } Rec_occ;
 
-// precompute binomial coefficients
-void binom_precompute();
+// generator of the canonical words, i.e., starting with 0 and not larger than
+// the reversal, complemented if it ends with 1 so that it also starts with 0
+// the bits in fixed_mask are fixed to those of fixed, and the other ones
+// (except the first letter) are enumerated in increasing order as a counter
+// whose values are taken in [cnt, end), which makes ranges for parallel use
+// all the values are visited, and the non-canonical words are filtered out
+typedef struct {
+    Word w;
+    int mult;       // number of words in the class of w starting with 0: 2, or 1
+                    // if the word is its own reversal (complemented)
+    u64 fixed;
+    u64 free_mask;  // the bits that are enumerated
+    u64 cnt;        // the next value of the counter
+    u64 end;
+} Canon_gen;
 
-// return the precomputed binomial coefficients
-u64 binomial(int i, int j);
+// create a new context with precomputed binomial coefficients and empty cache
+// progress messages are written to log (may be NULL)
+Sw_ctx* sw_ctx_new(FILE* log);
 
-// build the struct Word with an external array
-Word build_word(u64 wordbin, int len, int* tab);
+// free a context and its cache
+void sw_ctx_free(Sw_ctx* ctx);
 
-// debug purpose
-void print_word(Word* word);
+// return the precomputed binomial coefficients
+u64 binomial(Sw_ctx* ctx, int i, int j);
+
+// build the struct Word, the bits beyond len are discarded
+Word build_word(u64 wordbin, int len);
 
-// printing the word, does not use the field "run"
-void print_word_bin(Word word);
+// convert the word to a 0-1 string, str should have length at least MAXLEN + 1
+void word_to_str(Word word, char* str);
 
 // debug purpose
 bool is_equal_word(Word* word1, Word* word2);
@@ -96,6 +277,14 @@ bool increment_word(Word* word);
 // returns false if cannot continue
 bool increment_word_2(Word* word);
 
+// generator of the canonical words with len bits, with the counter of the free
+// bits in [start, end), end = 0 for all; the first word is given by canon_next
+Canon_gen canon_gen_new(int len, u64 fixed_mask, u64 fixed, u64 start, u64 end);
+
+// go to the next canonical word in gen->w, returns false if there is none
+// about two values of the counter are tested for each word given
+bool canon_next(Canon_gen* gen);
+
 // add a bit at the end
 void add_bit(Word* word, int bit);
 
@@ -103,9 +292,52 @@ void add_bit(Word* word, int bit);
 void remove_bit(Word* word);
 
 // returns the number of subword occurrences
-u64 subword_cnt(Word word, Word subword);
+u64 subword_cnt(Sw_ctx* ctx, Word word, Word subword);
+
+// counting engines, see subword_cnt_engine
+#define ENGINE_RECURSIVE 0 // divide and conquer on the middle run, cached
+#define ENGINE_RUNDP 1     // DP over the runs of w and of the subword
+#define ENGINE_BITDP 2     // DP over the letters of w and of the subword
+#define ENGINE_COUNT 3
+
+// returns the number of subword occurrences with the given engine, for a word
+// and a subword with the same first letter and the same last letter
+u64 subword_cnt_engine(Sw_ctx* ctx, Word word, Word subword, int engine);
+
+// whether subword_cnt may call the recursive engine for words up to n bits,
+// with the thresholds of the context. Otherwise the cache is never read, and
+// there is no point in warming or replicating it
+bool cache_engine_used(Sw_ctx* ctx, int n);
 
 // set to be used in a parallel way, i.e., forbidding insertions in cache
-void set_parallel_mode();
+void set_parallel_mode(Sw_ctx* ctx);
+
+// insert a count computed elsewhere in the cache, w and sw with the same ends
+// the entry may be refused if the memory budget of the cache is reached
+void cache_insert(Sw_ctx* ctx, Word w, Word sw, u64 cnt);
+
+// limit the memory of the cache to the given number of bytes, 0 for no limit
+// once the budget is reached, entries that are cheap to recompute are evicted
+// and no longer admitted; should not be called while the cache is frozen
+void set_cache_budget(Sw_ctx* ctx, u64 bytes);
+
+// copy the frozen cache into the memory of each NUMA node (a single copy on
+// machines with one node), returns the number of copies. The copies are not
+// updated, so the cache should not change any more
+int cache_replicate(Sw_ctx* ctx);
+
+// bind the calling thread to the node of the copy idx % replica_cnt, and
+// look up in that copy instead of the cache when counting for this context;
+// does nothing without copies
+void cache_bind_replica(Sw_ctx* ctx, int idx);
+
+// time lookups of a sample of the cache from a thread on the first node, in
+// the cache and in each copy, and write them to the log next to the number of
+// lookups that the searches since the warm-up made past the first-level caches
+void cache_replica_latency(Sw_ctx* ctx);
+
+// add the statistics of the first-level cache of the calling thread to the
+// context, should be called by each thread at the end of its work
+void l1_stats_collect(Sw_ctx* ctx);
 
 #endif
\ No newline at end of file
@@ -25,6 +25,9 @@
 #include "swcnt.hpp"
 #include "fibogen.hpp"
 #include <map>
+#include <vector>
+#include <stdio.h>
+#include <time.h>
 
 // number of threads used in parallel mode, should always be a power of 2
 #ifndef THREAD_COUNT
@@ -33,36 +36,260 @@
 
 typedef std::map<u64, u64> Histogram;
 
+// a record that prunes nothing, for words of any length (up to MAXLEN); a
+// record of at least 2^n for words of n bits is the same
+#define NO_RECORD (~0ULL)
+
+// number of words drawn at once in sampling mode, the stopping conditions are
+// checked between rounds, and only the first words of a round that are all
+// evaluated are kept, so that results only depend on the seed
+#define SAMPLE_ROUND 256
+
+// certificate files of the exhaustive search: a header of three u64 (magic,
+// n, number of threads), then chunks of a u64 thread id and a u64 size in
+// bytes, followed by runs, and a last chunk with id CERT_END and the result
+// as size. The words of a thread are those of the parallel search, in the
+// same order, so only the pruning subwords are written, each with the number
+// of consecutive words that it prunes, both as LEB128 varints
+#define CERT_MAGIC 0x3274726563636f6dULL // "moccert2"
+#define CERT_END (~0ULL)
+#define CERT_CHUNK 65536 // bytes of runs written at once by a thread
+#define CERT_RUN_BYTES 20 // at most two varints of 10 bytes
+
+// files of the table of maxocc of all the words of m bits: a header of two
+// u64 (magic, m), then the maxocc of the words starting with 0 in binary
+// order, as u16 capped at 65535, which is still a lower bound. A word has at
+// least the maxocc of each of its factors, so a factor above the record
+// prunes it without counting any subword
+#define ORACLE_MAGIC 0x31636172306f6d6dULL // "mmo0rac1"
+#define ORACLE_FILE "maxocc%d.oracle" // default name, with m
+
+// thread information for the table of maxocc
+typedef struct {
+    Sw_ctx* ctx;
+    int m;
+    int thread_id;
+    uint16_t* table;
+} Oracle_info;
+
+// runs of a thread not yet written, the last one may still grow
+typedef struct {
+    FILE* out;
+    u64 thread_id;
+    u64 sw;  // subword of the last run, as (1 << len) + bits
+    u64 cnt; // number of words of the last run, 0 if none
+    int size;
+    unsigned char data[CERT_CHUNK];
+} Cert_buf;
+
+// the words of the exhaustive search are visited in blocks of consecutive
+// values of the counter of the canonical words, with at most 2^ORDER_BITS
+// blocks for each thread. The blocks whose common prefix has the smallest
+// maxocc, a lower bound of the maxocc of their words, come first, so that
+// the record drops early and prunes the rest. Every block is visited, and
+// the subword hint of the filter is reset at the start of each one
+#define ORDER_BITS 10
+
+// generator of the canonical words of a thread, block by block in the order
+// of the search; the current word is gen.w
+typedef struct {
+    Canon_gen gen; // the words of the current block
+    u64 fixed_mask;
+    u64 fixed;
+    u64 block_size;
+    std::vector<u64> blocks; // first counters of the blocks, in order
+    size_t next; // index of the next block
+    bool block_start; // the current word is the first one of its block
+} Order_gen;
+
+// depth-first search over the subwords of w of length k starting with 0 and
+// ending with the last letter of w, in the order of increment_word_2. Each
+// prefix carries its embeddings in w, so that a letter more costs O(w.len),
+// and a prefix is cut if its completions cannot beat the maximum so far
+typedef struct {
+    Sw_ctx* ctx;
+    Word w;
+    int k;
+    u64 letters[MAXLEN]; // letters of w from the left
+    u64 rows[MAXLEN + 1][MAXLEN]; // rows[d][q]: embeddings of the prefix of
+                                  // length d with the last letter at q
+    u64 maxocc;
+    u64 record; // the search stops at the first subword above the record
+    Word recsw; // which is kept here
+    std::vector<Word>* subwords; // if not NULL, the subwords reaching maxocc
+    std::atomic<u64>* shared; // maximum of all the threads, may be NULL
+    bool stop;
+} Sw_dfs;
+
+// the subwords of a single word are split for the threads in units of a
+// length and the first letters, with WORD_UNIT_BITS letters after the first 0
+#define WORD_UNIT_BITS 8
+
+// a unit of the subwords of a single word, with its maximum and the subwords
+// reaching it, none if the maximum of the other units was not reached
+typedef struct {
+    int k;
+    u64 prefix;
+    u64 maxocc;
+    std::vector<Word> subwords;
+} Word_unit;
+
+// thread information for a single word, units are taken in order
+typedef struct {
+    Sw_ctx* ctx;
+    Word w;
+    std::vector<Word_unit>* units;
+    std::atomic<u64>* next;
+    std::atomic<u64>* best; // largest maxocc of the units so far
+} Word_info;
+
+// the file of hints is polled every HINT_POLL_MS milliseconds by a thread
+// during the exhaustive search, for a better hint found meanwhile
+#define HINT_POLL_MS 200
+
+// the thread watching the file of hints
+typedef struct {
+    Sw_ctx* ctx;
+    std::atomic<bool> stop;
+    pthread_t thread;
+} Hint_watch;
+
 // thread information for parallelism
 typedef struct {
+    Sw_ctx* ctx;
     int n;
     int thread_id;
     u64 record;
     Rec_occ* minrec;
+    FILE* cert; // where certificates go, NULL for none
 } Thread_info;
 
+// thread information for checking the certificates of a thread of the search
+typedef struct {
+    Sw_ctx* ctx;
+    const char* path;
+    int n;
+    int threads;
+    int thread_id;
+    std::vector<long>* chunks; // offsets of the chunks of the thread
+    u64 minocc; // smallest subword count found
+    u64 words;
+    bool valid;
+} Cert_info;
+
+// a subword count found in the warm-up of the cache
+typedef struct {
+    Word w;
+    Word sw;
+    u64 cnt;
+} Warm_pair;
+
+// thread information for the warm-up of the cache
+typedef struct {
+    Sw_ctx* ctx;
+    int len;
+    int thread_id;
+    std::vector<Warm_pair>* found;
+} Warm_info;
+
+// thread information for sampling mode, the words of a round are taken in
+// order, and evaluated until the deadline (0 for none) is passed
+typedef struct {
+    Sw_ctx* ctx;
+    Word* words;
+    u64* occs;
+    char* done;
+    std::atomic<int>* next;
+    time_t deadline;
+} Sample_info;
+
 // Returns the words with the minimal value of most frequence occurrences
 // Each word may have several subwords reaching the same number of occurrences
 // And we may have several words with the same numbers
-Rec_occ min_maxfreq_subword_hinted(int n, u64 record);
+// The record is kept in ctx->live_record, lowered by a number in the file
+// ctx->hint_file if there is one, which should be the maxocc of a word of n
+// bits as any hint; otherwise nothing is found (as with a too small hint)
+Rec_occ min_maxfreq_subword_hinted(Sw_ctx* ctx, int n, u64 record);
 
 // The same as the function above, but only for some of the words
 // Used for the parallel version
 void* min_maxfreq_subword_hinted_parallel(void* info);
 
+// the canonical words of len bits with the bits in fixed_mask fixed to those
+// of fixed, as with canon_gen_new, in the order of the exhaustive search
+Order_gen order_gen_new(Sw_ctx* ctx, int len, u64 fixed_mask, u64 fixed);
+
+// go to the next word in gen->gen.w, returns false if there is none
+bool order_next(Order_gen* gen);
+
+// The same as min_maxfreq_subword_hinted, on THREAD_COUNT threads
+// The cache is frozen, so it should be filled before
+// If cert is not NULL, a certificate of the result is written to it
+Rec_occ min_maxfreq_subword_hinted_mt(Sw_ctx* ctx, int n, u64 record, FILE* cert);
+
+// check the certificate file written by the parallel search on words of n
+// bits, with plain subword counts on as many threads as the search. Returns
+// the smallest count of the certificates, a lower bound of the maxocc of all
+// words, and the result claimed by the search in claimed; 0 if the file is
+// not a complete certificate. The cache is frozen, so it should be filled
+u64 cert_verify(Sw_ctx* ctx, int n, const char* path, u64* claimed);
+
+// evaluate the given words in order as the exhaustive search does, but without
+// updating the record, returns the number of words not pruned by it
+u64 eval_words_hinted(Sw_ctx* ctx, const Word* words, u64 cnt, u64 record);
+
 // compute the maxfreq for subwords in a given word. Used in metaheuristics.
-Rec_sw maxfreq_subword_hinted_fast(Word w, u64 record);
+Rec_sw maxfreq_subword_hinted_fast(Sw_ctx* ctx, Word w, u64 record);
 
 // compute most frequent subwords for a single given word. Used in computing for a single word.
-Rec_sw maxfreq_subword_single(Word w, u64 record);
+Rec_sw maxfreq_subword_single(Sw_ctx* ctx, Word w, u64 record);
+
+// the same as maxfreq_subword_single without a record, on THREAD_COUNT
+// threads, with the same subwords in the same order. Subwords are counted
+// directly in w, so the cache is not used
+Rec_sw maxfreq_subword_mt(Sw_ctx* ctx, Word w);
+
+// compute the maxocc of all the words of m bits (at least 8, at most
+// ORACLE_MAXLEN) on THREAD_COUNT threads and write them to path as a table,
+// returns false if the file cannot be written
+bool oracle_build(Sw_ctx* ctx, int m, const char* path);
+
+// map the table in path, probed by the exhaustive search on the factors of
+// each word, except when a certificate is written as the table gives no
+// subword. Returns false if the file is not a valid table
+bool oracle_load(Sw_ctx* ctx, const char* path);
+
+// fill the cache with all the pairs of a word with less than max_cache_run runs
+// and at most maxlen letters and one of its subwords with the same ends, which
+// are those the search can ask for, from short to long on THREAD_COUNT threads
+// lengths already done by a previous call are skipped
+void warm_cache_pairs(Sw_ctx* ctx, int maxlen);
 
 // returns histogram of max subword occurrences
-Histogram maxfreq_subword_histo(int n);
+Histogram maxfreq_subword_histo(Sw_ctx* ctx, int n);
+
+// the maxocc of a word, over subwords of all lengths, as in the histogram
+u64 maxfreq_subword(Sw_ctx* ctx, Word w);
+
+// estimated histogram of max subword occurrences, from uniform random words
+// starting with 0 drawn with the given seed and evaluated on THREAD_COUNT
+// threads, which does not use the cache (it is frozen all the same)
+// stops when the 95% confidence intervals of all frequencies are narrower than
+// +-precision, or after the given number of seconds (0 for no limit)
+// the total of the histogram is the number of samples
+Histogram maxfreq_subword_sample(Sw_ctx* ctx, int n, u64 seed, double precision, double seconds);
+
+// 95% confidence interval (Wilson score) of a frequency of cnt out of total
+void sample_interval(u64 cnt, u64 total, double* low, double* high);
 
 // compute max freq subword of some lenghts, for metaheuristics.
-u64 maxfreq_subword_fast(Word w);
+u64 maxfreq_subword_fast(Sw_ctx* ctx, Word w);
 
 // for metaheuristics
-Rec_sw maxfreq_subword_hinted_fast(Word w, u64 record);
+Rec_sw maxfreq_subword_hinted_fast(Sw_ctx* ctx, Word w, u64 record);
+
+// the same as above, but only returns the maxocc (or something larger than the
+// record), without any allocation
+u64 maxfreq_subword_hinted_fast_occ(Sw_ctx* ctx, Word w, u64 record);
 
 #endif
\ No newline at end of file
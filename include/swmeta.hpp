@@ -25,6 +25,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <math.h>
+#include <pthread.h>
 #include "swcnt.hpp"
 #include "swexhaust.hpp"
 #include "swutils.hpp"
@@ -32,7 +34,73 @@
 // multiplier for full neighborhood search
 #define ITER_MULT 2000
 
+// number of combinations taken at once by a thread scanning a neighborhood
+#define SCAN_CHUNK 16
+
+// thread information for the parallel scan of a neighborhood of w, the
+// combinations of flipped bits are taken by chunks in order
+typedef struct {
+    Sw_ctx* ctx;
+    Word w;
+    u64 record;
+    std::vector<u64>* combs;
+    std::atomic<size_t>* next;  // first combination of the next chunk
+    std::atomic<size_t>* found; // smallest improving combination found so far
+} Scan_info;
+
+// number of threads verifying the candidates of the metaheuristic
+#define VERIFY_THREADS 2
+
+// maximal number of candidates waiting for verification, the oldest ones are
+// dropped when the search goes faster than the verification
+#define VERIFY_BACKLOG 64
+
+// candidates screened by the fast maxocc, queued for the exact one computed
+// by background threads, each with its own context. Only the verified best
+// record is published
+typedef struct {
+    Sw_ctx* ctx; // of the search, for the log and the cache budget
+    Word words[VERIFY_BACKLOG];
+    int head;
+    int cnt;
+    int busy;  // candidates taken but not verified yet
+    bool stop;
+    Rec_sw best; // best verified record
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+    pthread_cond_t idle;
+    pthread_t thrds[VERIFY_THREADS];
+} Verifier;
+
+// parameters of the engines with a time budget
+typedef struct {
+    double seconds;  // budget of CPU time
+    u64 seed;        // seed of the random generator, the runs are reproducible
+    double temp;     // annealing: initial temperature, relative to the maxocc
+    double cooling;  // annealing: final temperature, relative to the initial one
+    int tenure;      // tabu: number of iterations a flipped position is tabu
+    std::vector<std::pair<double, u64>>* trace; // (CPU time, maxocc) of each
+                                                // new record, may be NULL
+} Meta_params;
+
+// default parameters with a budget in seconds and a seed
+Meta_params meta_params_default(double seconds, u64 seed);
+
+// simulated annealing flipping one bit at a time, the temperature decreases
+// geometrically with the CPU time used
+Rec_sw simulated_annealing(Sw_ctx* ctx, int n, Meta_params* params);
+
+// tabu search, moving to the best neighbor with one bit flipped, even if it is
+// worse, except the recently flipped positions unless it is a new record
+Rec_sw tabu_search(Sw_ctx* ctx, int n, Meta_params* params);
+
 // metaheuristic, mixing iterative deepening exhaustive local search
-void mixed_descent(int n, int maxk, u64 maxiter);
+// progress is written to the log of the context, the new records of the
+// search are verified in the background, returns the best verified record.
+// The random words and flips are drawn from the seed, not from rand()
+Rec_sw mixed_descent(Sw_ctx* ctx, int n, int maxk, u64 maxiter, u64 seed);
+
+// local search from a given word, with radius up to maxk
+Rec_sw local_descent(Sw_ctx* ctx, Word w, int maxk);
 
 #endif
\ No newline at end of file
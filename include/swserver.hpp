@@ -0,0 +1,60 @@
+/******************************************************************************
+
+    swmain - a research tool for minimizing maximal subword occurrences
+    
+    Copyright (C) 2024 Wenjie Fang <fwjmath@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+******************************************************************************/
+
+
+#ifndef __SWSERVER__
+#define __SWSERVER__
+
+#include <stdio.h>
+#include <pthread.h>
+#include "swcnt.hpp"
+#include "swexhaust.hpp"
+#include "swutils.hpp"
+#include "swmeta.hpp"
+
+// maximal number of clients waiting for a worker
+#define SERVER_BACKLOG 256
+
+// queue of accepted connections, served by a pool of THREAD_COUNT workers
+typedef struct {
+    int fds[SERVER_BACKLOG];
+    int head;
+    int cnt;
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty;
+} Conn_queue;
+
+// information shared by the workers
+typedef struct {
+    Sw_ctx* ctx;
+    Conn_queue* queue;
+} Server_info;
+
+// answer queries on the Unix domain socket at path, with a single context.
+// The protocol is line-based, one query per line:
+//   maxocc <word>        -> ok <maxocc> <subword> <subword> ...
+//   insert <word>        -> ok <new word> <maxocc (fast)>
+//   local <word> <k>     -> ok <word> <maxocc (fast)>
+//   ping                 -> ok
+// and "error <message>" for invalid queries. Only returns on errors.
+void serve_queries(Sw_ctx* ctx, const char* path);
+
+#endif
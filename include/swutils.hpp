@@ -25,30 +25,66 @@
 #include <stdio.h>
 #include <string.h>
 #include <pthread.h>
+#include <queue>
 #include "swcnt.hpp"
 #include "swexhaust.hpp"
 
-// build a word according to a 0-1 string, the run array should be offered
-Word build_word_str(const char* str, bool is_subword, Runtab wruns);
+// thread information for the beam search by insertions, the candidates are
+// shared and taken in order, the best maxocc so far are kept for pruning
+typedef struct {
+    Sw_ctx* ctx;
+    std::vector<Word>* cands;
+    u64* occs;
+    std::atomic<size_t>* next;
+    std::priority_queue<u64>* best; // the beam smallest maxocc found so far
+    int beam;
+    pthread_mutex_t* lock;
+} Beam_info;
 
-// exhaustive search for minimal subword entropy, using a hint
-// using subword with large number of occurrences from the last word as a hint
-void hinted_search(int n, u64 hint);
+// file of the tuning profiles, if the variable MAXOCC_TUNE does not give one
+#define TUNE_FILE "maxocc.tune"
 
-// the parallel version of the function above
-void hinted_search_parallel(int n, u64 hint);
+// a parameter of the context that a tuning profile may set
+typedef struct {
+    const char* name;
+    int* value;
+} Tune_param;
 
-// build a histogram for subword occurrences
-void histo_subword(int n);
+// build a word according to a 0-1 string
+Word build_word_str(const char* str);
 
-// print record
-void print_record(Rec_sw* minrec);
+// print record to a given file
+void fprint_record(FILE* out, Rec_sw* minrec);
 
-// compute the most frequent subwords of a given word
-void compute_maxfreq_subword(char* wstr);
+// fill the cache for words with n bits, before freezing it in parallel mode;
+// does nothing if the engines do not use the cache, see cache_engine_used
+void warm_cache(Sw_ctx* ctx, int n);
 
-// adds a letter somewhere in a hinted word (previous record)
-// computation is heuristic, not complete (fast variant)
-void insert_heuristic(char* wstr);
+// beam search by insertions: from the parent words (of the same length), each
+// round inserts a letter at each position of the words in the beam, and keeps
+// the beam best new words up to reversal and complement. The new words are
+// evaluated exactly on THREAD_COUNT threads, pruned by the beam-th best maxocc
+// found so far. Returns the records of the last round, from the best
+std::vector<Rec_sw> insert_beam(Sw_ctx* ctx, std::vector<Word> parents, int rounds, int beam);
+
+// set the parameters of the context from the profile for words with n bits in
+// the file at path, one line per n: "n <n>" and pairs "<name> <value>".
+// Returns false if there is no profile for n
+bool load_tuning(Sw_ctx* ctx, int n, const char* path);
+
+// replace the profile for n in the file at path by the parameters of the
+// context, the profiles for other n are kept. Returns false if it cannot write
+bool save_tuning(Sw_ctx* ctx, int n, const char* path);
+
+// the parameters that a profile may set, at most 16, returns their number
+int tune_params(Sw_ctx* ctx, Tune_param* params);
+
+// write the parameters of the context as pairs, in the format of the profiles
+void fprint_tuning(FILE* out, Sw_ctx* ctx);
+
+// adds a letter somewhere in a hinted word (previous record), computation is
+// heuristic, not complete (fast variant). Returns the fast maxocc and the new
+// word in neww
+u64 insert_heuristic_word(Sw_ctx* ctx, Word oldw, Word* neww);
 
 #endif
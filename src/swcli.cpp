@@ -0,0 +1,534 @@
+/******************************************************************************
+
+    swmain - a research tool for minimizing maximal subword occurrences
+    
+    Copyright (C) 2024 Wenjie Fang <fwjmath@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+******************************************************************************/
+
+#include "swcli.hpp"
+#include <algorithm>
+
+// print record
+void print_record(Rec_sw* minrec){
+    fprint_record(stdout, minrec);
+    return;
+}
+
+// print the word in binary
+void print_word_bin(Word word){
+    char str[MAXLEN + 1];
+    word_to_str(word, str);
+    printf("%s\n", str);
+    return;
+}
+
+// debug purpose
+void print_word(Word* word){
+    char str[MAXLEN + 1];
+    word_to_str(*word, str);
+    printf("Binary: %s\nRuns: ", str);
+    for(int i = 0; i < word->runcnt; i++) printf("%d ", word_run(*word, i));
+    printf("\n");
+    return;
+}
+
+// print the hit rate of the first-level caches, if the cache is used
+static void print_l1_stats(Sw_ctx* ctx, int n){
+    if(!cache_engine_used(ctx, n)) return;
+    u64 lookups = ctx->l1_lookups;
+    u64 hits = ctx->l1_hits;
+    printf("L1 cache: %lu hits out of %lu lookups (%.1f%%)\n", hits, lookups,
+           lookups ? 100.0 * hits / lookups : 0.0);
+    return;
+}
+
+// print the words pruned by the table of maxocc, if there is one
+static void print_oracle_stats(Sw_ctx* ctx){
+    if(ctx->oracle == NULL) return;
+    printf("Oracle of %d bits: %lu words pruned\n", ctx->oracle_len, (u64) ctx->oracle_pruned);
+    return;
+}
+
+// the result of an exhaustive search, with its hint (NO_RECORD for none)
+static void print_search(int n, u64 hint, u64 found){
+    if(hint == NO_RECORD) printf("%d bits, no hint, found %lu\n", n, found);
+    else printf("%d bits, hint %lu, found %lu\n", n, hint, found);
+    return;
+}
+
+// exhaustive search for minimal subword entropy, using a hint
+// using subword with large number of occurrences from the last word as a hint
+void hinted_search(Sw_ctx* ctx, int n, u64 hint){
+    Rec_occ minrec = min_maxfreq_subword_hinted(ctx, n, hint);
+    print_search(n, hint, minrec.occ);
+    for(auto rec : minrec.recs){
+        print_record(&rec);
+    }
+    print_l1_stats(ctx, n);
+    print_oracle_stats(ctx);
+    return;
+}
+
+// exhaustive search for minimal subword entropy, using a hint, parallel version
+void hinted_search_parallel(Sw_ctx* ctx, int n, u64 hint, const char* certpath){
+    FILE* cert = NULL;
+    if(certpath != NULL && (cert = fopen(certpath, "wb")) == NULL){
+        printf("Cannot open certificate file %s\n", certpath);
+        return;
+    }
+    Rec_occ minrec = min_maxfreq_subword_hinted_mt(ctx, n, hint, cert);
+    if(cert != NULL) fclose(cert);
+    print_search(n, hint, minrec.occ);
+    for(auto rec : minrec.recs){
+        print_record(&rec);
+    }
+    print_l1_stats(ctx, n);
+    print_oracle_stats(ctx);
+    return;
+}
+
+// check the certificate of a parallel search
+void verify_search(Sw_ctx* ctx, int n, const char* certpath){
+    u64 claimed = 0;
+    u64 bound = cert_verify(ctx, n, certpath, &claimed);
+    if(bound == 0){
+        printf("Invalid or incomplete certificate %s for %d bits\n", certpath, n);
+    }else if(bound >= claimed){
+        printf("%d bits, certificate confirms maxocc at least %lu, claimed %lu\n", n, bound, claimed);
+    }else{
+        printf("%d bits, certificate only proves maxocc at least %lu, claimed %lu\n", n, bound, claimed);
+    }
+    print_l1_stats(ctx, n);
+    return;
+}
+
+// build the table of maxocc of all the words of m bits
+void build_oracle(Sw_ctx* ctx, int m, const char* path){
+    char name[64];
+    if(path == NULL){
+        snprintf(name, sizeof(name), ORACLE_FILE, m);
+        path = name;
+    }
+    if(!oracle_build(ctx, m, path)){
+        printf("Cannot build the table of %d bits in %s\n", m, path);
+        return;
+    }
+    printf("Table of maxocc of %d bits written to %s\n", m, path);
+    return;
+}
+
+// build a histogram for subword occurrences
+void histo_subword(Sw_ctx* ctx, int n){
+    Histogram histo = maxfreq_subword_histo(ctx, n);
+    printf("Maximal subword occurrences histogram for %d bits\n{\n", n);
+    for(const auto& [freq, cnt] : histo){
+        printf("%lu: %lu\n", freq, cnt);
+    }
+    printf("}\n");
+    return;
+}
+
+// estimate a histogram for subword occurrences by sampling, each frequency
+// comes with its 95% confidence interval
+void sample_histo_subword(Sw_ctx* ctx, int n, u64 seed, double precision, double seconds){
+    Histogram histo = maxfreq_subword_sample(ctx, n, seed, precision, seconds);
+    u64 total = 0;
+    for(const auto& [freq, cnt] : histo) total += cnt;
+    if(total == 0){
+        printf("No word evaluated within the time budget\n");
+        return;
+    }
+    printf("Estimated maximal subword occurrences histogram for %d bits\n", n);
+    printf("%lu samples with seed %lu, frequency: (estimation, low, high)\n{\n", total, seed);
+    for(const auto& [freq, cnt] : histo){
+        double low, high;
+        sample_interval(cnt, total, &low, &high);
+        printf("%lu: (%.6f, %.6f, %.6f),\n", freq, (double) cnt / total, low, high);
+    }
+    printf("}\n");
+    return;
+}
+
+// compute the most frequent subwords of a given word
+void compute_maxfreq_subword(Sw_ctx* ctx, char* wstr){
+    Rec_sw minrec = maxfreq_subword_mt(ctx, build_word_str(wstr));
+    printf("Word %s, maxocc %lu\n", wstr, minrec.occ);
+    print_record(&minrec);
+    return;
+}
+
+// evaluate the words of a chunk in batch mode, the chunk is shared
+static void* batch_chunk_parallel(void* info){
+    Batch_info binfo = *((Batch_info*) info);
+    Sw_ctx* ctx = binfo.ctx;
+    Batch_chunk* chunk = binfo.chunk;
+    for(int i = binfo.thread_id; i < chunk->cnt; i += THREAD_COUNT){
+        if(!chunk->valid[i]) continue;
+        Word w = chunk->words[i];
+        chunk->recs[i] = maxfreq_subword_single(ctx, w, NO_RECORD);
+    }
+    l1_stats_collect(ctx);
+    return NULL;
+}
+
+// write the results of a chunk in batch mode, one JSON object per line
+static void batch_chunk_output(Batch_chunk* chunk, FILE* out){
+    char str[MAXLEN + 1];
+    for(int i = 0; i < chunk->cnt; i++){
+        if(!chunk->valid[i]){
+            fprintf(out, "{\"line\": %ld, \"error\": \"invalid word\"}\n",
+                    chunk->lines[i]);
+            continue;
+        }
+        word_to_str(chunk->words[i], str);
+        fprintf(out, "{\"line\": %ld, \"word\": \"%s\", \"maxocc\": %lu, \"subwords\": [",
+                chunk->lines[i], str, chunk->recs[i].occ);
+        for(size_t j = 0; j < chunk->recs[i].subwords.size(); j++){
+            word_to_str(chunk->recs[i].subwords[j], str);
+            fprintf(out, j == 0 ? "\"%s\"" : ", \"%s\"", str);
+        }
+        fprintf(out, "]}\n");
+        chunk->recs[i].subwords.clear();
+    }
+    fflush(out);
+    return;
+}
+
+// compute the most frequent subwords of many words with n bits, in parallel
+void batch_maxfreq_subword(Sw_ctx* ctx, int n, FILE* in, FILE* out){
+    Batch_chunk* chunk = new Batch_chunk;
+    Batch_info batch_info[THREAD_COUNT];
+    pthread_t thrds[THREAD_COUNT];
+    char* buf = NULL; // whole lines, however long
+    size_t bufsize = 0;
+    long lineno = 0;
+    // set parallel mode, freeze the cache
+    set_parallel_mode(ctx);
+    bool has_next = true;
+    while(has_next){
+        // read a chunk of words, skipping empty lines
+        chunk->cnt = 0;
+        while(chunk->cnt < BATCH_CHUNK){
+            if(getline(&buf, &bufsize, in) < 0){
+                has_next = false;
+                break;
+            }
+            lineno++;
+            int len = strcspn(buf, " \t\r\n");
+            if(len == 0) continue;
+            buf[len] = 0;
+            int i = chunk->cnt;
+            chunk->lines[i] = lineno;
+            chunk->valid[i] = (len == n && (int) strspn(buf, "01") == len);
+            if(chunk->valid[i]) chunk->words[i] = build_word_str(buf);
+            chunk->cnt++;
+        }
+        if(chunk->cnt == 0) break;
+        // evaluate the chunk in parallel
+        for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+            batch_info[thread_id].ctx = ctx;
+            batch_info[thread_id].thread_id = thread_id;
+            batch_info[thread_id].chunk = chunk;
+            pthread_create(thrds + thread_id, NULL, batch_chunk_parallel, batch_info + thread_id);
+        }
+        for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+            pthread_join(thrds[thread_id], NULL);
+        }
+        batch_chunk_output(chunk, out);
+    }
+    free(buf);
+    delete chunk;
+    return;
+}
+
+// adds a letter somewhere in a hinted word (previous record), using incomplete
+// computation
+void insert_heuristic(Sw_ctx* ctx, char* wstr){
+    Word neww;
+    u64 recocc = insert_heuristic_word(ctx, build_word_str(wstr), &neww);
+    print_word_bin(neww);
+    printf("Maxocc (fast): %lu\n", recocc);
+    return;
+}
+
+// beam search by insertions from the given words
+void insert_beam_search(Sw_ctx* ctx, int n, int beam, char** wstrs, int cnt){
+    std::vector<Word> parents;
+    for(int i = 0; i < cnt; i++) parents.push_back(build_word_str(wstrs[i]));
+    std::vector<Rec_sw> recs = insert_beam(ctx, parents, n - parents[0].len, beam);
+    printf("Best maxocc by insertions with %d bits: %lu\n", n, recs[0].occ);
+    for(auto rec : recs){
+        print_record(&rec);
+    }
+    return;
+}
+
+// write the result of an exhaustive search for n as one JSON object
+static void campaign_output(FILE* out, int n, u64 hint, Rec_occ* minrec){
+    char str[MAXLEN + 1];
+    fprintf(out, "{\"n\": %d, \"hint\": ", n);
+    fprintf(out, hint == NO_RECORD ? "null" : "%lu", hint);
+    fprintf(out, ", \"maxocc\": %lu, \"words\": [", minrec->occ);
+    for(size_t i = 0; i < minrec->recs.size(); i++){
+        word_to_str(minrec->recs[i].word, str);
+        fprintf(out, "%s{\"word\": \"%s\", \"subwords\": [", i == 0 ? "" : ", ", str);
+        for(size_t j = 0; j < minrec->recs[i].subwords.size(); j++){
+            word_to_str(minrec->recs[i].subwords[j], str);
+            fprintf(out, j == 0 ? "\"%s\"" : ", \"%s\"", str);
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "]}\n");
+    fflush(out);
+    return;
+}
+
+// chain the insertion heuristic and the exhaustive search over several n
+void campaign(Sw_ctx* ctx, int nmin, int nmax, u64 hint, FILE* out){
+    Rec_occ minrec;
+    for(int n = nmin; n <= nmax; n++){
+        if(n > nmin){
+            // best exact maxocc of the insertions in all the optimal words of
+            // n - 1, the maxocc of a word is always an upper bound
+            std::vector<Word> parents;
+            for(auto rec : minrec.recs) parents.push_back(rec.word);
+            hint = insert_beam(ctx, parents, 1, 1)[0].occ;
+        }
+        if(hint == NO_RECORD) printf("Campaign: %d bits, no hint\n", n);
+        else printf("Campaign: %d bits, hint %lu\n", n, hint);
+        // only the new lengths are added to the cache
+        warm_cache(ctx, n);
+        minrec = min_maxfreq_subword_hinted_mt(ctx, n, hint, NULL);
+        print_search(n, hint, minrec.occ);
+        for(auto rec : minrec.recs){
+            print_record(&rec);
+        }
+        if(minrec.recs.empty()){
+            printf("No word found, the hint is too small\n");
+            return;
+        }
+        campaign_output(out, n, hint, &minrec);
+    }
+    return;
+}
+
+// a fresh context with the parameters of base, frozen after the warm-up or
+// growing as in the serial search
+static Sw_ctx* tune_ctx(Sw_ctx* base, int n, bool frozen){
+    Sw_ctx* ctx = sw_ctx_new(NULL);
+    Tune_param params[16], baseparams[16];
+    int cnt = tune_params(ctx, params);
+    tune_params(base, baseparams);
+    for(int i = 0; i < cnt; i++) *params[i].value = *baseparams[i].value;
+    set_cache_budget(ctx, base->cache_budget);
+    if(frozen){
+        warm_cache(ctx, n);
+        set_parallel_mode(ctx);
+    }
+    return ctx;
+}
+
+// CPU time of one evaluation of the sample with the parameters of base, the
+// evaluation is repeated for at least TUNE_MIN_SECONDS, on the same frozen
+// context or on a fresh one each time in serial mode, as the cache grows
+static double tune_trial(Sw_ctx* base, int n, std::vector<Word>& words, u64 record, bool frozen, u64* kept){
+    Sw_ctx* ctx = NULL;
+    double total = 0;
+    int reps = 0;
+    while(total < TUNE_MIN_SECONDS){
+        if(ctx == NULL || !frozen){
+            if(ctx != NULL) sw_ctx_free(ctx);
+            ctx = tune_ctx(base, n, frozen);
+        }
+        clock_t start = clock();
+        *kept = eval_words_hinted(ctx, words.data(), words.size(), record);
+        total += (double) (clock() - start) / CLOCKS_PER_SEC;
+        reps++;
+    }
+    sw_ctx_free(ctx);
+    return total / reps;
+}
+
+// try the values of a parameter, the current one first, and keep the one with
+// the fastest median of TUNE_RUNS trials. A value replaces the best one so far
+// only if it is faster by more than 2% and more than the spread of the trials
+// of both, i.e., the noise. Returns whether the current value was replaced
+static bool tune_sweep(Sw_ctx* ctx, int n, std::vector<Word>& words, u64 record, bool frozen,
+                       const char* name, int* value, std::vector<int> cands){
+    int current = *value;
+    cands.erase(std::remove(cands.begin(), cands.end(), current), cands.end());
+    cands.insert(cands.begin(), current);
+    int best = current;
+    double besttime = -1, bestnoise = 0;
+    u64 refkept = 0;
+    for(int cand : cands){
+        *value = cand;
+        double secs[TUNE_RUNS];
+        u64 kept;
+        for(int r = 0; r < TUNE_RUNS; r++){
+            secs[r] = tune_trial(ctx, n, words, record, frozen, &kept);
+            if(besttime < 0 && r == 0) refkept = kept;
+            if(kept != refkept) printf("Warning: %lu words kept instead of %lu\n", kept, refkept);
+        }
+        std::sort(secs, secs + TUNE_RUNS);
+        double median = secs[TUNE_RUNS / 2];
+        double noise = (secs[TUNE_RUNS - 1] - secs[0]) / median;
+        printf("%s %d: %.6f s (median of %d, spread %.1f%%)\n", name, cand, median, TUNE_RUNS, 100 * noise);
+        fflush(stdout);
+        if(besttime < 0 || median < besttime * (1 - std::max(0.02, std::max(noise, bestnoise)))){
+            best = cand;
+            besttime = median;
+            bestnoise = noise;
+        }
+    }
+    *value = best;
+    return best != current;
+}
+
+// sweep each parameter in turn, the engines first, then the cache if it is used
+void autotune(Sw_ctx* ctx, int n, int blocks, u64 hint, const char* path){
+    if(n < 8){
+        printf("Too few bits to tune\n");
+        return;
+    }
+    // blocks of consecutive canonical words, as the search meets them
+    std::vector<Word> words;
+    u64 state = 1;
+    for(int b = 0; b < blocks; b++){
+        Canon_gen gen = canon_gen_new(n, 0, 0, random_next(&state) & low_mask(n - 1), 0);
+        for(int i = 0; i < TUNE_BLOCK && canon_next(&gen); i++) words.push_back(gen.w);
+    }
+    u64 record = hint;
+    if(record == 0){
+        record = NO_RECORD;
+        for(Word w : words){
+            u64 occ = maxfreq_subword(ctx, w);
+            if(occ < record) record = occ;
+        }
+    }
+    printf("Tuning for %d bits on %lu words with record %lu\n", n, words.size(), record);
+    // start from the defaults
+    ctx->max_cache_run = MAX_CACHE_RUN;
+    ctx->insert_margin = 0;
+    ctx->warm_maxlen = 0;
+    ctx->bitdp_maxlen = BITDP_MAXLEN;
+    ctx->rundp_slackpct = RUNDP_SLACKPCT;
+    bool changed = false;
+    changed |= tune_sweep(ctx, n, words, record, false, "bitdp_maxlen", &ctx->bitdp_maxlen, {0, 8, 12, 16});
+    changed |= tune_sweep(ctx, n, words, record, false, "rundp_slackpct", &ctx->rundp_slackpct, {-1, 20, 40, 60, 80});
+    // the parameters of the cache only matter if the engines use it
+    if(cache_engine_used(ctx, n)){
+        changed |= tune_sweep(ctx, n, words, record, false, "max_cache_run", &ctx->max_cache_run, {5, 7, 9, 11, 13});
+        changed |= tune_sweep(ctx, n, words, record, false, "insert_margin", &ctx->insert_margin, {0, 1, 2, 4, 8});
+        std::vector<int> lens;
+        for(int len = std::max(2, (n >> 1) - 3); len <= std::min(18, (n >> 1) + 1); len++) lens.push_back(len);
+        changed |= tune_sweep(ctx, n, words, record, true, "warm_maxlen", &ctx->warm_maxlen, lens);
+    }else{
+        printf("The engines do not use the cache, its parameters are not tuned\n");
+    }
+    // a profile within the noise would only make later runs depend on luck
+    if(!changed){
+        printf("No value is faster than the defaults beyond the noise, no profile written\n");
+        return;
+    }
+    if(!save_tuning(ctx, n, path)){
+        printf("Cannot write the tuning profile to %s\n", path);
+        return;
+    }
+    printf("Tuning profile for %d bits written to %s: ", n, path);
+    fprint_tuning(stdout, ctx);
+    printf("\n");
+    return;
+}
+
+// compare the counting engines on random pairs, and time them by length of
+// the subword, only the recursive engine uses the cache of the context
+void engines_check(Sw_ctx* ctx, int n, int pairs, u64 seed){
+    const char* names[ENGINE_COUNT] = {"recursive", "rundp", "bitdp"};
+    std::vector<Word> ws, sws;
+    u64 state = seed;
+    for(int i = 0; i < pairs; i++){
+        Word w = build_word(random_next(&state) & low_mask(n - 1), n);
+        int k = 2 + random_next(&state) % (n - 1);
+        // the same ends as w
+        u64 bits = random_next(&state) & low_mask(k);
+        bits = (bits & ~(1ULL << (k - 1)) & ~1ULL) | (w.bits & 1);
+        ws.push_back(w);
+        sws.push_back(build_word(bits, k));
+    }
+    // the pairs by length of the subword, timed together
+    std::vector<int> bylen[MAXLEN + 1];
+    for(int i = 0; i < pairs; i++) bylen[sws[i].len].push_back(i);
+    std::vector<u64> cnts[ENGINE_COUNT];
+    double secs[ENGINE_COUNT][MAXLEN + 1] = {};
+    for(int e = 0; e < ENGINE_COUNT; e++){
+        cnts[e].resize(pairs);
+        for(int k = 2; k <= n; k++){
+            clock_t start = clock();
+            for(int i : bylen[k]) cnts[e][i] = subword_cnt_engine(ctx, ws[i], sws[i], e);
+            secs[e][k] = (double) (clock() - start) / CLOCKS_PER_SEC;
+        }
+    }
+    int bad = 0;
+    char str[MAXLEN + 1], swstr[MAXLEN + 1];
+    for(int i = 0; i < pairs; i++){
+        for(int e = 1; e < ENGINE_COUNT; e++){
+            if(cnts[e][i] == cnts[0][i]) continue;
+            if(bad++ < 10){
+                word_to_str(ws[i], str);
+                word_to_str(sws[i], swstr);
+                printf("Mismatch: %s in %s, %s %lu, %s %lu\n", swstr, str,
+                       names[0], cnts[0][i], names[e], cnts[e][i]);
+            }
+        }
+    }
+    printf("%d pairs of %d bits, %d mismatches\n", pairs, n, bad);
+    printf("length");
+    for(int e = 0; e < ENGINE_COUNT; e++) printf(" %10s", names[e]);
+    printf("  (ns per count)\n");
+    for(int k = 2; k <= n; k++){
+        if(bylen[k].empty()) continue;
+        printf("%6d", k);
+        for(int e = 0; e < ENGINE_COUNT; e++) printf(" %10.0f", secs[e][k] * 1e9 / bylen[k].size());
+        printf("\n");
+    }
+    return;
+}
+
+// comparison of the engines with a time budget on fixed seeds
+void meta_compare(Sw_ctx* ctx, int n, double seconds, int seedcnt){
+    const char* names[2] = {"annealing", "tabu"};
+    FILE* log = ctx->log;
+    ctx->log = NULL; // only the summary
+    printf("engine seed: best maxocc at CPU seconds\n");
+    for(int engine = 0; engine < 2; engine++){
+        for(int seed = 1; seed <= seedcnt; seed++){
+            std::vector<std::pair<double, u64>> trace;
+            Meta_params params = meta_params_default(seconds, seed);
+            params.trace = &trace;
+            Rec_sw rec = (engine == 0) ? simulated_annealing(ctx, n, &params)
+                                       : tabu_search(ctx, n, &params);
+            printf("%s %d:", names[engine], seed);
+            for(auto [cpu, occ] : trace) printf(" %lu@%.2f", occ, cpu);
+            char str[MAXLEN + 1];
+            word_to_str(rec.word, str);
+            printf("\n%s %d: final %lu with %s\n", names[engine], seed, rec.occ, str);
+        }
+    }
+    ctx->log = log;
+    return;
+}
\ No newline at end of file
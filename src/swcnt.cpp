@@ -20,13 +20,32 @@
 ******************************************************************************/
 
 #include "swcnt.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
 
-u64 binom[MAXLEN][MAXLEN];
-Cache swcnt[MAXLEN][MAXLEN]; // indices are #bits
-u64 parallel_mask = -1; // -1 by default means serial mode. 0 to set means parallel mode
+// first-level cache of each thread, with its statistics
+static thread_local L1_entry l1_cache[1 << L1_CACHE_BITS];
+static thread_local u64 l1_lookups = 0;
+static thread_local u64 l1_hits = 0;
+
+// copy of the frozen cache used by the thread, for the context with the given
+// serial only: a thread may count for several contexts, and an address could
+// be reused by a context created after another is freed
+typedef struct {
+    u64 serial;
+    const Cache_replica* replica;
+} Replica_binding;
+static thread_local Replica_binding binding = {0, NULL};
+
+// serial of the last context created, 0 is never bound
+static std::atomic<u64> ctx_serial(0);
 
 // precompute the table
-void binom_precompute(){
+static void binom_precompute(Sw_ctx* ctx){
+    u64 (*binom)[MAXLEN] = ctx->binom;
     // clean the table
     for(int i = 0; i < MAXLEN; i++)
         for(int j = 0; j < MAXLEN; j++)
@@ -42,46 +61,76 @@ void binom_precompute(){
     return;
 }
 
+// create a new context, serial mode by default
+Sw_ctx* sw_ctx_new(FILE* log){
+    Sw_ctx* ctx = new Sw_ctx;
+    binom_precompute(ctx);
+    ctx->parallel_mask = -1;
+    ctx->cache_budget = 0;
+    ctx->cache_entries = 0;
+    ctx->cache_min_score = 0;
+    ctx->warm_len = 1;
+    ctx->warm_maxlen = 0;
+    ctx->max_cache_run = MAX_CACHE_RUN;
+    ctx->insert_margin = 0;
+    ctx->bitdp_maxlen = BITDP_MAXLEN;
+    ctx->rundp_slackpct = RUNDP_SLACKPCT;
+    ctx->search_threads = 1;
+    ctx->deterministic = true;
+    ctx->log = log;
+    ctx->l1_lookups = 0;
+    ctx->l1_hits = 0;
+    ctx->replicas = NULL;
+    ctx->replica_cnt = 0;
+    ctx->serial = ++ctx_serial;
+    ctx->ttable = NULL;
+    ctx->tt_lookups = 0;
+    ctx->tt_hits = 0;
+    ctx->oracle = NULL;
+    ctx->oracle_len = 0;
+    ctx->oracle_map = NULL;
+    ctx->oracle_bytes = 0;
+    ctx->oracle_pruned = 0;
+    ctx->live_record = ~0ULL;
+    ctx->hint_file = NULL;
+    return ctx;
+}
+
+// free a context and its cache
+void sw_ctx_free(Sw_ctx* ctx){
+    for(int i = 0; i < ctx->replica_cnt; i++){
+        munmap(ctx->replicas[i].slots, ctx->replicas[i].bytes);
+    }
+    delete[] ctx->replicas;
+    delete[] ctx->ttable;
+    if(ctx->oracle_map != NULL) munmap(ctx->oracle_map, ctx->oracle_bytes);
+    delete ctx;
+    return;
+}
+
 // extraction of precomputed results
-u64 binomial(int i, int j){
-    return binom[i][j];
+u64 binomial(Sw_ctx* ctx, int i, int j){
+    return ctx->binom[i][j];
+}
+
+// compute the run boundaries of the given bits, see the definition of Word
+static inline u64 word_bound(u64 bits, int len){
+    if(len == 0) return 0;
+    return ((bits ^ (bits >> 1)) & low_mask(len - 1)) | (1ULL << (len - 1));
 }
 
-// build struct word with external array
-Word build_word(u64 wordbin, int len, Runtab tab){
+// build struct word, everything is computed from the bits
+Word build_word(u64 wordbin, int len){
     Word w;
-    w.bits = wordbin;
     w.len = len;
-    w.run = tab;
-    // first reverse the bits so that it is easier later
-    u64 rev = 0;
-    for(int i = 0; i < len; i++){
-        rev <<= 1;
-        rev += wordbin & 1;
-        wordbin >>= 1;
-    }
-    // then we count the runs using intrinsics
-    if(rev & 1) rev = ~rev; // always keeping rightmost run 0
-    int unread = len;
-    for(w.runcnt = 0; ; w.runcnt++) { // from right to left in runs here
-        int zcnt = std::countr_zero(rev);
-        if(zcnt >= unread){ // all zero
-            w.run[w.runcnt] = unread;
-            w.runcnt++;
-            break;
-        }
-        w.run[w.runcnt] = zcnt;
-        unread -= zcnt;
-        rev >>= zcnt;
-        rev = ~rev; // exchange 0 and 1, keep rightmost run 0
-    }
+    w.bits = wordbin & low_mask(len);
+    w.bound = word_bound(w.bits, len);
+    w.runcnt = std::popcount(w.bound);
     return w;
 }
 
-// print the word, does not use the field "run"
-void print_word_bin(Word word){
-    // convert binary representation
-    char str[65];
+// convert the word to a 0-1 string, str should have length at least MAXLEN + 1
+void word_to_str(Word word, char* str){
     u64 bits = word.bits;
     int len = word.len;
     for(int i = len - 1; i >= 0; i--){
@@ -89,73 +138,26 @@ void print_word_bin(Word word){
         bits >>= 1;
     }
     str[len] = 0;
-    printf("%s\n", str);
     return;
 }
 
-// debug purpose
-void print_word(Word* word){
-    // convert binary representation
-    char str[65];
-    u64 bits = word->bits;
-    int len = word->len;
-    for(int i = len - 1; i >= 0; i--){
-        str[i] = '0' + (bits & 1);
-        bits >>= 1;
-    }
-    str[len] = 0;
-    printf("Binary: %s\nRuns: ", str);
-    for(int i = 0; i < word->runcnt; i++) printf("%d ", word->run[i]);
-    printf("\n");
-    return;
-}
 
 // debug purpose
 bool is_equal_word(Word* word1, Word* word2){
-    if(!(word1->bits == word2->bits 
-      && word1->len  == word2->len
-      && word1->runcnt  == word2->runcnt
-    )) return false;
-    for(int i = 0; i < word1->runcnt; i++){
-        if(word1->run[i] != word2->run[i]) return false;
-    }
-    return true;
+    return word1->bits == word2->bits
+        && word1->bound == word2->bound
+        && word1->len  == word2->len
+        && word1->runcnt  == word2->runcnt;
 }
 
 // increment a word, we suppose that the word here is not a segment
+// the runs are recomputed from the bits, which is cheaper than maintaining them
 bool increment_word(Word* word){
+    // ending condition: 01111...111
+    if(word->bits == low_mask(word->len - 1)) return false;
     word->bits++;
-    if(word->runcnt & 1){
-        // odd number of segments, thus ending with 0
-        if(word->run[word->runcnt - 1] > 1){
-            // more than one 0, new run of 1 of size 1
-            word->run[word->runcnt - 1]--;
-            word->run[word->runcnt] = 1;
-            word->runcnt++;
-        } else {
-            // only one 0, fusion with previous run of 1
-            word->runcnt--;
-            word->run[word->runcnt - 1]++;
-        }
-    } else {
-        // even number of segments, thus ending with 1
-        if(word->run[word->runcnt - 2] > 1){ // at least two runs
-            // more than one 0 in the segment before, the last run is now zero
-            // new run of size 1
-            word->run[word->runcnt] = word->run[word->runcnt - 1];
-            word->run[word->runcnt - 1] = 1;
-            word->run[word->runcnt - 2]--;
-            word->runcnt++;
-        } else {
-            // only one 0 in the segment before, fusion with previous run
-            // test ending condition: 01111...111
-            if(word->runcnt == 2) return false;
-            // at least 4 runs
-            word->run[word->runcnt - 3]++;
-            word->run[word->runcnt - 2] = word->run[word->runcnt - 1];
-            word->runcnt--;
-        }
-    }
+    word->bound = word_bound(word->bits, word->len);
+    word->runcnt = std::popcount(word->bound);
     return true;
 }
 
@@ -165,6 +167,41 @@ bool increment_word_2(Word* word){
     return increment_word(word);
 }
 
+// generator of canonical words, the first letter is always fixed to 0
+Canon_gen canon_gen_new(int len, u64 fixed_mask, u64 fixed, u64 start, u64 end){
+    Canon_gen gen;
+    gen.w = build_word(0, len);
+    gen.mult = 0;
+    gen.free_mask = low_mask(len - 1) & ~fixed_mask;
+    gen.fixed = fixed & fixed_mask & low_mask(len - 1);
+    gen.cnt = start;
+    u64 total = 1ULL << std::popcount(gen.free_mask);
+    gen.end = (end == 0 || end > total) ? total : end;
+    // no word if the fixed bits are beyond the first letter, or on it with 1
+    if(fixed & fixed_mask & ~low_mask(len - 1)) gen.end = 0;
+    return gen;
+}
+
+// this is a filter, not an orderly generation: every value of the counter is
+// built, and about half of them are rejected, each with a reversal in constant
+// time. The test mostly depends on the low bits (the first letters of the
+// reversal), so the rejected words do not come in blocks that could be jumped
+bool canon_next(Canon_gen* gen){
+    int len = gen->w.len;
+    while(gen->cnt < gen->end){
+        u64 bits = deposit_bits(gen->cnt++, gen->free_mask) | gen->fixed;
+        u64 rev = reverse_bits(bits, len);
+        if(bits & 1) rev ^= low_mask(len);
+        if(bits > rev) continue;
+        gen->mult = (bits < rev) ? 2 : 1;
+        gen->w.bits = bits;
+        gen->w.bound = word_bound(bits, len);
+        gen->w.runcnt = std::popcount(gen->w.bound);
+        return true;
+    }
+    return false;
+}
+
 void add_bit(Word* word, int bit){
     // normalize
     bit &= 1;
@@ -173,181 +210,562 @@ void add_bit(Word* word, int bit){
     word->bits += bit;
     word->len++;
     // adjust the runs
-    if((word->runcnt & 1) == bit){ // different letter
-        word->run[word->runcnt] = 1;
-        word->runcnt++;
-    } else {
-        word->run[word->runcnt - 1]++;
-    }
+    word->bound = word_bound(word->bits, word->len);
+    word->runcnt = std::popcount(word->bound);
     return;
 }
 
 void remove_bit(Word* word){
     word->bits >>= 1;
     word->len--;
-    word->run[word->runcnt - 1]--;
-    if(word->run[word->runcnt - 1] == 0) word->runcnt--;
+    word->bound = word_bound(word->bits, word->len);
+    word->runcnt = std::popcount(word->bound);
     return;
 }
 
+// highest bit of the run just after the one with highest bit top, -1 if none
+static inline int next_run_top(u64 bound, int top){
+    return 63 - std::countl_zero(bound & low_mask(top));
+}
+
 // compute the index of the first run of w after the leftmost possible
 // occurrences of sw in w
-inline static int count_run_idx(int* wrun, int wruncnt, int* swrun, int swruncnt){
-    int idx = 0;
-    int sidx = 0;
-    int curswrun = swrun[sidx];
-    while(sidx < swruncnt){
-        if(idx >= wruncnt) return -1;
-        if(wrun[idx] < curswrun){
-            curswrun -= wrun[idx];
-            idx += 2;
-        } else {
-            sidx++;
-            idx++;
-            curswrun = swrun[sidx];
-        }
+// each run of sw is matched at once: we look for the bit of w where the needed
+// number of letters is reached with popcount and pdep, instead of walking the
+// runs of w one by one
+inline static int count_run_idx(Word w, Word sw){
+    int top = w.len - 1; // highest bit of w not used yet
+    int stop = sw.len - 1; // highest bit of the current run of sw
+    u64 letter = (sw.bits >> stop) & 1;
+    for(int sidx = 0; sidx < sw.runcnt; sidx++){
+        int snext = next_run_top(sw.bound, stop);
+        int curswrun = stop - snext;
+        u64 avail = (letter ? w.bits : ~w.bits) & low_mask(top + 1);
+        int availcnt = std::popcount(avail);
+        if(availcnt < curswrun) return -1;
+        // the bit of w where this run of sw ends, we then skip its run in w
+        top = next_run_top(w.bound, select_bit(avail, availcnt - curswrun));
+        stop = snext;
+        letter ^= 1;
     }
-    return idx;
+    return std::popcount(w.bound & ~low_mask(top + 1)); // number of runs before top
 }
 
 // compute the index of the first run of w after the leftmost possible
 // occurrences of sw in w
-inline static int count_run_idx_rev(int* wrun, int wruncnt, int* swrun, int swruncnt){
-    int idx = wruncnt - 1;
-    int sidx = swruncnt - 1;
-    int curswrun = swrun[sidx];
-    while(sidx >= 0){
-        if(idx < 0) return -1;
-        if(wrun[idx] < curswrun){
-            curswrun -= wrun[idx];
-            idx -= 2;
-        } else {
-            sidx--;
-            idx--;
-            curswrun = swrun[sidx];
-        }
+inline static int count_run_idx_rev(Word w, Word sw){
+    int bottom = 0; // lowest bit of w not used yet
+    int sprev = -1; // highest bit of the previous run of sw
+    u64 srest = sw.bound;
+    u64 letter = sw.bits & 1;
+    for(int sidx = 0; sidx < sw.runcnt; sidx++){
+        int stop = std::countr_zero(srest);
+        int curswrun = stop - sprev;
+        srest &= srest - 1;
+        sprev = stop;
+        u64 avail = (letter ? w.bits : ~w.bits) & low_mask(w.len) & ~low_mask(bottom);
+        if(std::popcount(avail) < curswrun) return -1;
+        // the bit of w where this run of sw ends, we then skip its run in w
+        int pos = select_bit(avail, curswrun - 1);
+        bottom = std::countr_zero(w.bound & ~low_mask(pos)) + 1;
+        letter ^= 1;
     }
-    return idx;
+    // index of the run containing the bit bottom
+    return std::popcount(w.bound & ~low_mask(bottom)) - 1;
 }
 
-// cut the word at index run, and return the first part
-static inline Word cut_word_front(Word w, int run){
-    Word neww = w;
-    int accu = 0;
-    for(int i = 0; i < run; i++) accu += w.run[i];
-    neww.bits >>= w.len - accu; // only on the left that remains
-    // run table pointer does not change
+// cut the word at index run with highest bit top, and return the first part
+static inline Word cut_word_front_at(Word w, int run, int top){
+    Word neww;
+    int shift = top + 1; // number of bits on the right to drop
+    if(shift >= w.len) return {0, 0, 0, 0}; // avoid shifting by 64
+    neww.bits = w.bits >> shift; // only on the left that remains
+    neww.bound = w.bound >> shift;
     neww.runcnt = run;
-    neww.len = accu;
+    neww.len = w.len - shift;
     return neww;
 }
 
-// cut the word at index run, and return the second part
-static inline Word cut_word_back(Word w, int run){
-    Word neww = w;
-    int accu = 0;
-    for(int i = run; i < w.runcnt; i++) accu += w.run[i];
-    neww.bits &= (1ULL << accu) - 1; // only the right that remains
-    neww.run += run;
+// cut the word at index run with highest bit top, and return the second part
+static inline Word cut_word_back_at(Word w, int run, int top){
+    Word neww;
+    int accu = top + 1; // number of bits that remains
+    neww.bits = w.bits & low_mask(accu); // only the right that remains
+    neww.bound = w.bound & low_mask(accu);
     neww.runcnt = w.runcnt - run;
     neww.len = accu;
     return neww;
 }
 
+// cut the word at index run, and return the first part
+static inline Word cut_word_front(Word w, int run){
+    return cut_word_front_at(w, run, word_run_top(w, run));
+}
+
+// cut the word at index run, and return the second part
+static inline Word cut_word_back(Word w, int run){
+    return cut_word_back_at(w, run, word_run_top(w, run));
+}
+
+// slot of the first-level cache for the given pair, multiplicative hashing
+static inline L1_entry* l1_slot(Word w, Word sw, int lens){
+    u64 h = (w.bits * 0x9E3779B97F4A7C15ULL) ^ (sw.bits * 0xC2B2AE3D27D4EB4FULL) ^ lens;
+    h *= 0x165667B19E3779F9ULL;
+    return l1_cache + (h >> (64 - L1_CACHE_BITS));
+}
+
+// first slot of a pair in a replica, the same hashing as the L1 cache
+static inline u64 replica_hash(u64 wbits, u64 swbits, u64 lens){
+    u64 h = (wbits * 0x9E3779B97F4A7C15ULL) ^ (swbits * 0xC2B2AE3D27D4EB4FULL) ^ lens;
+    return h * 0x165667B19E3779F9ULL;
+}
+
+// the entry of a pair in a replica, NULL if absent
+static inline const Replica_entry* replica_find(const Cache_replica* rep, u64 wbits, u64 swbits, u64 lens){
+    u64 slot = (replica_hash(wbits, swbits, lens) >> 20) & rep->mask;
+    while(true){
+        const Replica_entry* entry = rep->slots + slot;
+        if(entry->lens == lens && entry->wbits == wbits && entry->swbits == swbits) return entry;
+        if(entry->lens == 0) return NULL;
+        slot = (slot + 1) & rep->mask;
+    }
+}
+
 // assuming w and sw starts with the same letter, and end also the same
-static u64 subword_cnt_raw(Word w, Word sw, int orig_wlen){
+static u64 subword_cnt_raw(Sw_ctx* ctx, Word w, Word sw, int orig_wlen){
     if(sw.runcnt == 0) return 1; // empty subword
     if(w.runcnt < sw.runcnt) return 0; // not enough run
+    // not enough letters, cheap now that the bits are always clean
+    int ones = std::popcount(w.bits);
+    int swones = std::popcount(sw.bits);
+    if(ones < swones || w.len - ones < sw.len - swones) return 0;
+    if(sw.runcnt == 1){ // a single run: choose its letters among those of w
+        return ctx->binom[(sw.bits & 1) ? ones : w.len - ones][sw.len];
+    }
     u64 accu = 0;
     // cut the subword into two
     int mididx = sw.runcnt / 2;
-    int midseg = sw.run[mididx];
+    int midseg = word_run(sw, mididx);
+    Word swfront = cut_word_front(sw, mididx);
+    Word swback = cut_word_back(sw, mididx + 1);
     // compute the runs of w that sw may span, get left and right index for wl
-    int lidx = count_run_idx(w.run, w.runcnt, sw.run, mididx);
-    int ridx = count_run_idx_rev(w.run, w.runcnt, 
-                                 sw.run + mididx + 1, sw.runcnt - mididx - 1);
+    int lidx = count_run_idx(w, swfront);
+    int ridx = count_run_idx_rev(w, swback);
     if(lidx > ridx || lidx < 0 || ridx >= w.runcnt){
-        // debug info
-        /* 
-        printf("Left and right index check failed: %d, %d\n", lidx, ridx);
-        print_word(&w);
-        print_word(&sw);
-        */
         return 0; // not possible
     }
-    // lookup
-    if(w.runcnt < MAX_CACHE_RUN){
-        auto search = swcnt[w.len][sw.len].find(u64pair(w.bits, sw.bits));
-        if(search != swcnt[w.len][sw.len].end()) return search->second;
+    // lookup, first in the cache of the thread, then in the shared one
+    int lens = (w.len << 8) + sw.len;
+    L1_entry* l1 = NULL;
+    if(w.runcnt < ctx->max_cache_run){
+        l1 = l1_slot(w, sw, lens);
+        l1_lookups++;
+        if(l1->lens == lens && l1->wbits == w.bits && l1->swbits == sw.bits){
+            l1_hits++;
+            return l1->cnt;
+        }
+        if(binding.serial == ctx->serial){
+            const Replica_entry* entry = replica_find(binding.replica, w.bits, sw.bits, lens);
+            if(entry != NULL){
+                *l1 = {w.bits, sw.bits, entry->cnt, lens};
+                return entry->cnt;
+            }
+        }else{
+            auto search = ctx->swcnt[w.len][sw.len].find(u64pair(w.bits, sw.bits));
+            if(search != ctx->swcnt[w.len][sw.len].end()){
+                *l1 = {w.bits, sw.bits, search->second, lens};
+                return search->second;
+            }
+        }
     }
     // cut in the middle and recursion (divide and conquer)
     // we look at where the middle segment could span, 
     // then cut the word and the subword into have and do recursion
-    Word swfront = cut_word_front(sw, mididx);
-    Word swback = cut_word_back(sw, mididx + 1);
+    // the runs of w from lidx to ridx + 1 are read once from their highest bits
+    int tops[MAXLEN + 1];
+    int *top = tops - lidx; // so that top[k] is the highest bit of run k
+    top[lidx] = word_run_top(w, lidx);
+    for(int k = lidx; k <= ridx; k++) top[k + 1] = next_run_top(w.bound, top[k]);
     if(lidx == ridx){
-        accu = binom[w.run[lidx]][midseg]; // middle span
-        accu *= subword_cnt_raw(cut_word_front(w, lidx), swfront, orig_wlen);
-        accu *= subword_cnt_raw(cut_word_back(w, lidx + 1), swback, orig_wlen); 
+        accu = ctx->binom[top[lidx] - top[lidx + 1]][midseg]; // middle span
+        accu *= subword_cnt_raw(ctx, cut_word_front_at(w, lidx, top[lidx]), swfront, orig_wlen);
+        accu *= subword_cnt_raw(ctx, cut_word_back_at(w, lidx + 1, top[lidx + 1]), swback, orig_wlen); 
     } else {
         for(int k = lidx; k < ridx + 2; k += 2){
             int wsegtotal = 0;
+            int wrunk = top[k] - top[k + 1];
             for(int l = k; l < ridx + 2; l += 2){
                 /*
                 int wsegtotal = 0;
-                for(int i = k; i < l + 2; i += 2) wsegtotal += w.run[i];
+                for(int i = k; i < l + 2; i += 2) wsegtotal += word_run(w, i);
                 */
-                wsegtotal += w.run[l];
-                int wsegin = wsegtotal - w.run[k] - w.run[l];
+                int wrunl = top[l] - top[l + 1];
+                wsegtotal += wrunl;
+                int wsegin = wsegtotal - wrunk - wrunl;
                 int64_t mult = 0;
                 // inclusion-exclusion principle for the middle span
                 // if k == l, only the first term will be non-zero
-                mult += binom[wsegtotal][midseg];
-                mult -= binom[wsegin + w.run[k]][midseg];
-                mult -= binom[wsegin + w.run[l]][midseg];
-                if(wsegin >= 0) mult += binom[wsegin][midseg];
+                mult += ctx->binom[wsegtotal][midseg];
+                mult -= ctx->binom[wsegin + wrunk][midseg];
+                mult -= ctx->binom[wsegin + wrunl][midseg];
+                if(wsegin >= 0) mult += ctx->binom[wsegin][midseg];
                 if(mult > 0){
-                    mult *= subword_cnt_raw(cut_word_front(w, k), swfront, orig_wlen);
-                    mult *= subword_cnt_raw(cut_word_back(w, l + 1), swback, orig_wlen);
+                    mult *= subword_cnt_raw(ctx, cut_word_front_at(w, k, top[k]), swfront, orig_wlen);
+                    mult *= subword_cnt_raw(ctx, cut_word_back_at(w, l + 1, top[l + 1]), swback, orig_wlen);
                     accu += mult;
                 }
             }
         }
     }
+    // the slot may have been used in the recursion, but it is ours again
+    if(l1 != NULL) *l1 = {w.bits, sw.bits, accu, lens};
     // restriction on length to limit memory usage and control for modification for parallelism
-    if(w.runcnt < MAX_CACHE_RUN && w.len <= orig_wlen){
-        swcnt[w.len][sw.len].insert({u64pair(w.bits, sw.bits), accu});
+    if(w.len + ctx->insert_margin <= orig_wlen) cache_insert(ctx, w, sw, accu);
+    return accu;
+}
+
+// run-level DP: cnt[b] is the number of embeddings of the runs of sw up to
+// the current one, the last letter being in the run b of w. The letters of a
+// run of sw are chosen among those of the runs of w with the same letter
+// after the one of the previous run, with at least one in b
+static u64 subword_cnt_rundp(Sw_ctx* ctx, Word w, Word sw){
+    if(sw.runcnt == 0) return 1;
+    if(w.runcnt < sw.runcnt) return 0;
+    int wrun[MAXLEN], swrun[MAXLEN];
+    int top = word_run_top(w, 0);
+    for(int k = 0; k < w.runcnt; k++){
+        int next = next_run_top(w.bound, top);
+        wrun[k] = top - next;
+        top = next;
+    }
+    top = word_run_top(sw, 0);
+    for(int k = 0; k < sw.runcnt; k++){
+        int next = next_run_top(sw.bound, top);
+        swrun[k] = top - next;
+        top = next;
     }
-    // debug info
-    /*
-    printf("Subcase result: %lu, %d, %d\n", accu, lidx, ridx);
-    print_word(&w);
-    print_word(&sw);
-    // print_word(&swfront);
-    // print_word(&swback);
-    */
+    u64 cnt[MAXLEN], newcnt[MAXLEN];
+    // first run of sw, in the runs of w with the same parity (same letter)
+    int total = 0;
+    for(int b = 0; b < w.runcnt; b++){
+        cnt[b] = 0;
+        if(b & 1) continue;
+        total += wrun[b];
+        cnt[b] = ctx->binom[total][swrun[0]] - ctx->binom[total - wrun[b]][swrun[0]];
+    }
+    // the run j of sw can only end in the runs j to w.runcnt - sw.runcnt + j
+    for(int j = 1; j < sw.runcnt; j++){
+        int m = swrun[j];
+        for(int b = 0; b < w.runcnt; b++) newcnt[b] = 0;
+        for(int i = j - 1; i < w.runcnt - sw.runcnt + j; i += 2){
+            if(cnt[i] == 0) continue;
+            total = 0;
+            for(int b = i + 1; b <= w.runcnt - sw.runcnt + j; b += 2){
+                total += wrun[b];
+                newcnt[b] += cnt[i] * (ctx->binom[total][m] - ctx->binom[total - wrun[b]][m]);
+            }
+        }
+        for(int b = 0; b < w.runcnt; b++) cnt[b] = newcnt[b];
+    }
+    u64 accu = 0;
+    for(int b = 0; b < w.runcnt; b++) accu += cnt[b];
     return accu;
 }
 
+// letter-level DP: cnt[j] is the number of embeddings of the first j letters
+// of sw in the letters of w read so far, O(w.len * sw.len)
+static u64 subword_cnt_bitdp(Sw_ctx* ctx, Word w, Word sw){
+    (void) ctx;
+    u64 cnt[MAXLEN + 1];
+    cnt[0] = 1;
+    for(int j = 1; j <= sw.len; j++) cnt[j] = 0;
+    for(int i = w.len - 1; i >= 0; i--){
+        u64 letter = (w.bits >> i) & 1;
+        // the letters of sw still reachable: at most len - i read, and enough
+        // letters of w left for the rest
+        int hi = std::min(sw.len, w.len - i);
+        int lo = std::max(1, sw.len - i);
+        for(int j = hi; j >= lo; j--){
+            if(((sw.bits >> (sw.len - j)) & 1) == letter) cnt[j] += cnt[j - 1];
+        }
+    }
+    return cnt[sw.len];
+}
+
+// the divide-and-conquer on the middle run, with the caches
+static u64 subword_cnt_recursive(Sw_ctx* ctx, Word w, Word sw){
+    return subword_cnt_raw(ctx, w, sw, w.len & ctx->parallel_mask);
+}
+
+// the engines, indexed by the ENGINE_ constants
+static u64 (* const cnt_engines[ENGINE_COUNT])(Sw_ctx*, Word, Word) = {
+    subword_cnt_recursive, subword_cnt_rundp, subword_cnt_bitdp
+};
+
+// count with a given engine, for w and sw with the same ends
+u64 subword_cnt_engine(Sw_ctx* ctx, Word w, Word sw, int engine){
+    return cnt_engines[engine](ctx, w, sw);
+}
+
 // count subword occurrences
-u64 subword_cnt(Word word, Word subword){
+u64 subword_cnt(Sw_ctx* ctx, Word word, Word subword){
     // get the words with the same tail
     if(((word.bits >> (word.len - 1)) & 1) != (subword.bits >> (subword.len - 1)) & 1){
-        word.len -= word.run[0];
-        word.run++;
-        word.runcnt--;
+        word = cut_word_back(word, 1);
     }
     // get the words with the same head
     if((word.bits & 1) != (subword.bits & 1)){
-        word.len -= word.run[word.runcnt - 1];
-        word.bits >>= word.run[word.runcnt - 1];
-        word.runcnt--;
+        word = cut_word_front(word, word.runcnt - 1);
     }
-    return subword_cnt_raw(word, subword, word.len & parallel_mask);
+    if(subword.len > word.len) return 0;
+    // the engine is chosen by the length and the runs, see the thresholds in
+    // the context: the recursion is quadratic in the runs of the word that
+    // the subword leaves unused (its slack), and a single run is a binomial
+    if(word.len <= ctx->bitdp_maxlen) return subword_cnt_bitdp(ctx, word, subword);
+    int slack = word.runcnt - subword.runcnt;
+    if(subword.runcnt > 1 && slack * 100 > subword.runcnt * ctx->rundp_slackpct){
+        return subword_cnt_rundp(ctx, word, subword);
+    }
+    return subword_cnt_raw(ctx, word, subword, word.len & ctx->parallel_mask);
+}
+
+// the words cut by subword_cnt have from 1 to n bits, those above
+// bitdp_maxlen go to the recursion at least with no slack, unless the
+// percentage is negative; subwords of a single run never read the cache
+bool cache_engine_used(Sw_ctx* ctx, int n){
+    if(n <= ctx->bitdp_maxlen) return false;
+    return ctx->rundp_slackpct >= 0;
 }
 
 // set to be used in a parallel way, i.e., forbidding insertions in cache
-void set_parallel_mode(){
-    parallel_mask = 0;
+void set_parallel_mode(Sw_ctx* ctx){
+    ctx->parallel_mask = 0;
+    return;
+}
+
+// estimated cost of recomputing a count, which is what an entry is worth
+// the middle loop of subword_cnt_raw is quadratic in the runs of w that the
+// subword does not use, and the recursion is linear in the runs of the subword
+static inline int cache_score(Word w, Word sw){
+    int slack = (w.runcnt - sw.runcnt) / 2 + 1;
+    return slack * slack * sw.runcnt;
+}
+
+// evict the entries with the lowest scores until only 3/4 of the budget is
+// used, so that it does not happen at each insertion
+static void cache_evict(Sw_ctx* ctx){
+    while(ctx->cache_entries > 0 && ctx->cache_entries * CACHE_ENTRY_BYTES > ctx->cache_budget / 4 * 3){
+        ctx->cache_min_score++;
+        for(int i = 0; i < MAXLEN; i++){
+            for(int j = 0; j < MAXLEN; j++){
+                ctx->cache_entries -= std::erase_if(ctx->swcnt[i][j], [&](const auto& entry){
+                    Word w = build_word(entry.first.first, i);
+                    Word sw = build_word(entry.first.second, j);
+                    return cache_score(w, sw) < ctx->cache_min_score;
+                });
+            }
+        }
+    }
+    if(ctx->log){
+        fprintf(ctx->log, "Cache budget reached, %lu entries kept with score at least %d\n",
+                ctx->cache_entries, ctx->cache_min_score);
+    }
+    return;
+}
+
+// insert a count if it is worth it, under the same restriction on runs
+void cache_insert(Sw_ctx* ctx, Word w, Word sw, u64 cnt){
+    if(w.runcnt >= ctx->max_cache_run) return;
+    if(ctx->cache_budget && (ctx->cache_entries + 1) * CACHE_ENTRY_BYTES > ctx->cache_budget){
+        cache_evict(ctx);
+    }
+    if(cache_score(w, sw) < ctx->cache_min_score) return;
+    if(ctx->swcnt[w.len][sw.len].insert({u64pair(w.bits, sw.bits), cnt}).second){
+        ctx->cache_entries++;
+    }
     return;
-}
\ No newline at end of file
+}
+
+// set the memory budget of the cache, evicting if it is already exceeded
+void set_cache_budget(Sw_ctx* ctx, u64 bytes){
+    ctx->cache_budget = bytes;
+    if(bytes && ctx->cache_entries * CACHE_ENTRY_BYTES > bytes) cache_evict(ctx);
+    return;
+}
+
+// add the statistics of the first-level cache of the calling thread
+void l1_stats_collect(Sw_ctx* ctx){
+    ctx->l1_lookups += l1_lookups;
+    ctx->l1_hits += l1_hits;
+    l1_lookups = 0;
+    l1_hits = 0;
+    return;
+}
+
+// the CPUs of each NUMA node from sysfs, returns the number of nodes, 0 if
+// the information is not there
+static int numa_nodes(cpu_set_t* cpus, int* nodes){
+    int cnt = 0;
+    for(int node = 0; node < 1024 && cnt < REPLICA_MAX_NODES; node++){
+        char path[64], list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE* in = fopen(path, "r");
+        if(in == NULL) continue;
+        bool ok = fgets(list, sizeof(list), in) != NULL;
+        fclose(in);
+        if(!ok) continue;
+        // a list of ranges such as 0-15,32-47
+        CPU_ZERO(cpus + cnt);
+        char* save;
+        for(char* range = strtok_r(list, ",\n", &save); range != NULL; range = strtok_r(NULL, ",\n", &save)){
+            int lo, hi;
+            int fields = sscanf(range, "%d-%d", &lo, &hi);
+            if(fields < 1) continue;
+            if(fields == 1) hi = lo;
+            for(int cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, cpus + cnt);
+        }
+        if(CPU_COUNT(cpus + cnt) == 0) continue; // memory-only node
+        nodes[cnt++] = node;
+    }
+    return cnt;
+}
+
+// memory for a replica, on huge pages if some are reserved, otherwise on
+// transparent huge pages if enabled
+static void* replica_alloc(size_t bytes){
+    void* mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(mem != MAP_FAILED) return mem;
+    mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(mem == MAP_FAILED) return NULL;
+    madvise(mem, bytes, MADV_HUGEPAGE);
+    return mem;
+}
+
+// fill a replica from a thread running on its node, so that the pages are
+// allocated there when first touched
+static void* replica_fill(void* info){
+    Sw_ctx* ctx = ((std::pair<Sw_ctx*, Cache_replica*>*) info)->first;
+    Cache_replica* rep = ((std::pair<Sw_ctx*, Cache_replica*>*) info)->second;
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &rep->cpus);
+    memset(rep->slots, 0, rep->bytes);
+    for(int i = 0; i < MAXLEN; i++){
+        for(int j = 0; j < MAXLEN; j++){
+            u64 lens = (i << 8) + j;
+            for(auto& entry : ctx->swcnt[i][j]){
+                u64 slot = (replica_hash(entry.first.first, entry.first.second, lens) >> 20) & rep->mask;
+                while(rep->slots[slot].lens != 0) slot = (slot + 1) & rep->mask;
+                rep->slots[slot] = {entry.first.first, entry.first.second, entry.second, lens};
+            }
+        }
+    }
+    return NULL;
+}
+
+// one replica per node, filled in parallel
+int cache_replicate(Sw_ctx* ctx){
+    if(ctx->replica_cnt > 0) return ctx->replica_cnt;
+    cpu_set_t cpus[REPLICA_MAX_NODES];
+    int nodes[REPLICA_MAX_NODES];
+    int cnt = numa_nodes(cpus, nodes);
+    if(cnt == 0){ // no NUMA information, a single node with all the CPUs
+        cnt = 1;
+        nodes[0] = 0;
+        sched_getaffinity(0, sizeof(cpu_set_t), cpus);
+    }
+    // at most half full
+    u64 entries = 0;
+    for(int i = 0; i < MAXLEN; i++) for(int j = 0; j < MAXLEN; j++) entries += ctx->swcnt[i][j].size();
+    u64 slots = 1024;
+    while(slots < 2 * entries) slots <<= 1;
+    size_t bytes = slots * sizeof(Replica_entry);
+    bytes = (bytes + (1 << 21) - 1) & ~(size_t) ((1 << 21) - 1); // huge pages of 2MB
+    ctx->replicas = new Cache_replica[cnt];
+    pthread_t thrds[REPLICA_MAX_NODES];
+    std::pair<Sw_ctx*, Cache_replica*> info[REPLICA_MAX_NODES];
+    int made = 0;
+    for(int i = 0; i < cnt; i++){
+        void* mem = replica_alloc(bytes);
+        if(mem == NULL) break;
+        ctx->replicas[made] = {(Replica_entry*) mem, slots - 1, bytes, nodes[i], cpus[i]};
+        info[made] = {ctx, ctx->replicas + made};
+        pthread_create(thrds + made, NULL, replica_fill, info + made);
+        made++;
+    }
+    for(int i = 0; i < made; i++) pthread_join(thrds[i], NULL);
+    ctx->replica_cnt = made;
+    if(ctx->log){
+        fprintf(ctx->log, "Cache replicated on %d node%s, %lu entries, %.1f MB each\n",
+                made, made > 1 ? "s" : "", entries, bytes / 1048576.0);
+    }
+    return made;
+}
+
+// the threads are spread over the nodes
+void cache_bind_replica(Sw_ctx* ctx, int idx){
+    if(ctx->replica_cnt == 0) return;
+    const Cache_replica* rep = ctx->replicas + idx % ctx->replica_cnt;
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &rep->cpus);
+    binding = {ctx->serial, rep};
+    return;
+}
+
+// where the sums of the counts looked up go, so that nothing is optimized out
+static volatile u64 lookup_sink;
+
+// nanoseconds per lookup
+static double lookup_time(Sw_ctx* ctx, const Cache_replica* rep, std::vector<Replica_entry>& keys, u64* sum){
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(auto& key : keys){
+        if(rep != NULL){
+            *sum += replica_find(rep, key.wbits, key.swbits, key.lens)->cnt;
+        }else{
+            *sum += ctx->swcnt[key.lens >> 8][key.lens & 255].find(u64pair(key.wbits, key.swbits))->second;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / keys.size();
+}
+
+// from the first node, which is remote for the other replicas
+static void* replica_latency(void* info){
+    Sw_ctx* ctx = (Sw_ctx*) info;
+    if(ctx->replica_cnt == 0) return NULL;
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &ctx->replicas[0].cpus);
+    // a sample of the keys, in random order
+    std::vector<Replica_entry> keys;
+    u64 state = 1;
+    for(int i = 0; i < MAXLEN; i++){
+        for(int j = 0; j < MAXLEN; j++){
+            for(auto& entry : ctx->swcnt[i][j]){
+                if(random_next(&state) % 16 == 0) keys.push_back({entry.first.first, entry.first.second, 0, (u64) (i << 8) + j});
+            }
+        }
+    }
+    if(keys.empty()) return NULL;
+    for(size_t i = keys.size() - 1; i > 0; i--) std::swap(keys[i], keys[random_next(&state) % (i + 1)]);
+    u64 sum = 0;
+    fprintf(ctx->log, "Cache lookups from node %d: %.1f ns in the shared cache", ctx->replicas[0].node,
+            lookup_time(ctx, NULL, keys, &sum));
+    for(int i = 0; i < ctx->replica_cnt; i++){
+        fprintf(ctx->log, ", %.1f ns in the copy on node %d", lookup_time(ctx, ctx->replicas + i, keys, &sum),
+                ctx->replicas[i].node);
+    }
+    // what the searches so far read, the hits of the first-level caches aside
+    u64 lookups = ctx->l1_lookups;
+    u64 hits = ctx->l1_hits;
+    fprintf(ctx->log, "\nCache lookups of the search: %lu in the %s, out of %lu in the first-level caches\n",
+            lookups - hits, ctx->replica_cnt ? "copies" : "shared cache", lookups);
+    lookup_sink = sum;
+    return NULL;
+}
+
+// on a thread of its own, so that the caller is not bound
+void cache_replica_latency(Sw_ctx* ctx){
+    if(ctx->log == NULL) return;
+    pthread_t thrd;
+    pthread_create(&thrd, NULL, replica_latency, ctx);
+    pthread_join(thrd, NULL);
+    return;
+}
@@ -21,27 +21,122 @@
 
 #include "swexhaust.hpp"
 #include <time.h>
+#include <math.h>
+#include <pthread.h>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-// compute max frequence subword with given length, for histogram, no speed up
-static inline u64 maxfreq_subword_len(Word w, int k){
-    u64 maxocc = 0;
-    Runtab wruns;
-    Word sw = build_word(w.bits & 1, k, wruns);
-    do {
-        u64 occ = subword_cnt(w, sw);
-        if(occ >= maxocc){
-            maxocc = occ;
+// a subword of the DFS with its count, updates as the loops over the
+// subwords did, with the ties or not
+static inline void sw_dfs_leaf(Sw_dfs* dfs, u64 bits, u64 occ){
+    if(dfs->subwords != NULL){
+        if(occ < dfs->maxocc) return;
+        if(occ > dfs->maxocc) dfs->subwords->clear();
+        dfs->subwords->push_back(build_word(bits, dfs->k));
+    }else if(occ <= dfs->maxocc){
+        return;
+    }
+    dfs->maxocc = occ;
+    if(dfs->shared != NULL){
+        u64 best = dfs->shared->load(std::memory_order_relaxed);
+        while(best < occ && !dfs->shared->compare_exchange_weak(best, occ));
+    }
+    if(occ > dfs->record){
+        dfs->recsw = build_word(bits, dfs->k);
+        dfs->stop = true;
+    }
+    return;
+}
+
+// the row of the prefix of length d extended by a letter, in rows[d + 1]:
+// the letter at q extends the embeddings of the prefix ending before q, with
+// enough letters of w left after q. Returns a bound on the counts of the
+// completions, and the count of the new prefix in total
+static inline u64 sw_dfs_extend(Sw_dfs* dfs, int d, u64 letter, u64* total){
+    int n = dfs->w.len;
+    int rest = dfs->k - d - 1; // letters after the new one
+    const u64* row = dfs->rows[d];
+    u64* newrow = dfs->rows[d + 1];
+    u64 sum = (d == 0) ? 1 : 0;
+    u64 bound = 0;
+    *total = 0;
+    for(int q = 0; q < n - rest; q++){
+        u64 cnt = (dfs->letters[q] == letter) ? sum : 0;
+        newrow[q] = cnt;
+        *total += cnt;
+        bound += cnt * dfs->ctx->binom[n - 1 - q][rest];
+        if(d > 0 && q < n - rest - 1) sum += row[q];
+    }
+    return bound;
+}
+
+// whether the completions of a prefix with the given bound may change the
+// maximum, also the one shared with other threads
+static inline bool sw_dfs_open(Sw_dfs* dfs, u64 bound){
+    u64 best = dfs->maxocc;
+    if(dfs->shared != NULL) best = std::max(best, dfs->shared->load(std::memory_order_relaxed));
+    return (dfs->subwords != NULL) ? bound >= best : bound > dfs->maxocc && bound >= best;
+}
+
+// extend the prefix bits of length d by each possible letter, in order
+static void sw_dfs(Sw_dfs* dfs, int d, u64 bits){
+    int rest = dfs->k - d - 1;
+    u64 first = 0, last = 1;
+    if(d == 0) last = 0;
+    if(rest == 0) first = last = dfs->w.bits & 1;
+    for(u64 letter = first; letter <= last && !dfs->stop; letter++){
+        u64 total;
+        u64 bound = sw_dfs_extend(dfs, d, letter, &total);
+        u64 newbits = (bits << 1) | letter;
+        if(rest == 0){
+            sw_dfs_leaf(dfs, newbits, total);
+        }else if(sw_dfs_open(dfs, bound)){
+            // otherwise no completion can change the maximum
+            sw_dfs(dfs, d + 1, newbits);
         }
-    } while(increment_word_2(&sw));
-    return maxocc;
+    }
+    return;
+}
+
+// start a DFS on the subwords of w of length k
+static inline void sw_dfs_init(Sw_dfs* dfs, Sw_ctx* ctx, Word w, int k, u64 record, std::vector<Word>* subwords){
+    dfs->ctx = ctx;
+    dfs->w = w;
+    dfs->k = k;
+    for(int q = 0; q < w.len; q++) dfs->letters[q] = (w.bits >> (w.len - 1 - q)) & 1;
+    dfs->maxocc = 0;
+    dfs->record = record;
+    dfs->subwords = subwords;
+    dfs->shared = NULL;
+    dfs->stop = false;
+    return;
+}
+
+// maxocc of the subwords of w of length k as enumerated by increment_word_2,
+// stopping at the first one above the record, put in recsw if not NULL; the
+// subwords reaching the maximum are put in subwords if not NULL
+static u64 maxfreq_subword_len_dfs(Sw_ctx* ctx, Word w, int k, u64 record, Word* recsw, std::vector<Word>* subwords){
+    Sw_dfs dfs;
+    sw_dfs_init(&dfs, ctx, w, k, record, subwords);
+    if(k >= 2 && k <= w.len) sw_dfs(&dfs, 0, 0);
+    if(dfs.stop && recsw != NULL) *recsw = dfs.recsw;
+    return dfs.maxocc;
+}
+
+// compute max frequence subword with given length, for histogram
+static inline u64 maxfreq_subword_len(Sw_ctx* ctx, Word w, int k){
+    return maxfreq_subword_len_dfs(ctx, w, k, ~0ULL, NULL, NULL);
 }
 
 // compute max freq subword of all lenghts, for histogram
-u64 maxfreq_subword(Word w){
+u64 maxfreq_subword(Sw_ctx* ctx, Word w){
     u64 maxocc = 0;
     // check different lengths
     for(int curk = 2; curk < w.len - 1; curk++){
-        u64 occ = maxfreq_subword_len(w, curk);
+        u64 occ = maxfreq_subword_len(ctx, w, curk);
         if(occ >= maxocc){
             maxocc = occ;
         }
@@ -50,11 +145,11 @@ u64 maxfreq_subword(Word w){
 }
 
 // compute max freq subword up to some length, for starting metaheuristics
-u64 maxfreq_subword_fast(Word w){
+u64 maxfreq_subword_fast(Sw_ctx* ctx, Word w){
     u64 maxocc = 0;
     // check different lengths
     for(int curk = w.len / 4; curk < w.len / 2; curk++){
-        u64 occ = maxfreq_subword_len(w, curk);
+        u64 occ = maxfreq_subword_len(ctx, w, curk);
         if(occ >= maxocc){
             maxocc = occ;
         }
@@ -62,45 +157,19 @@ u64 maxfreq_subword_fast(Word w){
     return maxocc;
 }
 
-// test whether it is the smallest in its equivalence class
-static inline int sym_mult(u64 bits, int len){
-    // clean up
-    bits &= (1ULL << len) - 1;
-    // reverse the bits
-    u64 rev = 0;
-    u64 orig = bits;
-    for(int i = 0; i < len; i++){
-        rev <<= 1;
-        rev += orig & 1;
-        orig >>= 1;
-    }
-    if(bits & 1){ // no chance for rev, as it starts with 1, better switch 0 and 1
-        rev = ~rev;
-        rev &= (1 << len) - 1;
-    }
-    if(bits < rev)
-        return 2;
-    else if(bits == rev)
-        return 1;
-    return 0; 
-}
-
 // returns histogram of max subword occurrences
-Histogram maxfreq_subword_histo(int n){
-    // construct the word
-    Runtab wordruns;
-    Word w = build_word(0, n, wordruns);
+Histogram maxfreq_subword_histo(Sw_ctx* ctx, int n){
+    // only the canonical words, with the size of their class
+    Canon_gen gen = canon_gen_new(n, 0, 0, 0, 0);
     // initialize the histogram
     Histogram histo = Histogram(); 
-    do {
-        int mult = sym_mult(w.bits, n);
-        if(mult == 0) continue; // only test primitive ones
-        u64 freq = maxfreq_subword(w);
+    while(canon_next(&gen)){
+        u64 freq = maxfreq_subword(ctx, gen.w);
         if(!histo.contains(freq)){
             histo[freq] = 0;
         }
-        histo[freq] += mult;
-    } while(increment_word(&w));
+        histo[freq] += gen.mult;
+    }
     return histo;
 }
 
@@ -108,39 +177,32 @@ Histogram maxfreq_subword_histo(int n){
 // exhaustive, but stops once we find a subword breaking record
 // as we will be taking maximum for a given word, when one subwordsuch is found,
 // no need to test further as it will not improve the record
-static void maxfreq_subword_len_hinted(Rec_sw* maxrec, int k, u64 record){
+static void maxfreq_subword_len_hinted(Sw_ctx* ctx, Rec_sw* maxrec, int k, u64 record){
     // first check: are there enough subwords occurrences?
     // need to check if the record is a real one or just the max
     // TODO: can we improve this?
-    if(record != (1ULL << maxrec->word.len) && binomial(maxrec->word.len, k) < record) return;
-    // initialization
+    // initialization, also for a length skipped
     maxrec->occ = 0;
     maxrec->subwords.clear();
-    Runtab swruns;
-    Word w = maxrec->word;
-    Word sw = build_word(w.bits & 1, k, swruns);
-    // the loop
-    do {
-        u64 occ = subword_cnt(w, sw);
-        if(occ >= maxrec->occ){
-            if(occ > maxrec->occ) maxrec->subwords.clear();
-            maxrec->occ = occ;
-            maxrec->subwords.push_back(sw);
-            if(occ > record) break;
-        }
-    } while(increment_word_2(&sw));
+    if(record != NO_RECORD && binomial(ctx, maxrec->word.len, k) < record) return;
+    maxrec->occ = maxfreq_subword_len_dfs(ctx, maxrec->word, k, record, NULL, &maxrec->subwords);
     return;
 }
 
-static Rec_sw maxfreq_subword_hinted(Word w, u64 record, Word* lastsw){
-    Rec_sw maxrec = {w, std::vector<Word>(), 1};
-    Rec_sw maxrec_len = {w, std::vector<Word>(), 1};
+// the same as above, but only computes the maximal number of occurrences,
+// without touching the heap; the first subword breaking the record is in recsw
+static u64 maxfreq_subword_len_hinted_occ(Sw_ctx* ctx, Word w, int k, u64 record, Word* recsw){
+    if(record != NO_RECORD && binomial(ctx, w.len, k) < record) return 0;
+    return maxfreq_subword_len_dfs(ctx, w, k, record, recsw, NULL);
+}
+
+// filter with heuristics
+// if one of the following constructed subword give something bigger than
+// the record, then we can stop. Returns its occurrences (0 if none found),
+// and the subword in foundsw
+static u64 maxfreq_subword_filter(Sw_ctx* ctx, Word w, u64 record, Word* lastsw, Word* foundsw){
     int lastsw_len = lastsw->len;
     u64 lastsw_bits = lastsw->bits;
-    Runtab swruntab;
-    // filter with heuristics
-    // if one of the following constructed subword give something bigger than
-    // the record, then we can stop
     u64 newbits[3];
     // first filter: replace the last bit
     newbits[0] = lastsw_bits & (~(u64)1) + (w.bits & 1);
@@ -150,35 +212,32 @@ static Rec_sw maxfreq_subword_hinted(Word w, u64 record, Word* lastsw){
     newbits[2] = lastsw_bits;
     for(int i = 0; i < 3; i++){
         int newlen = (i == 1 ? lastsw_len + 1 : lastsw_len); 
-        Word newsw = build_word(newbits[i], newlen, swruntab);
-        u64 filter_occ = subword_cnt(w, newsw);
+        Word newsw = build_word(newbits[i], newlen);
+        u64 filter_occ = subword_cnt(ctx, w, newsw);
         if(filter_occ > record){
-            maxrec.subwords.push_back(newsw);
-            maxrec.occ = filter_occ;
-            return maxrec;
+            *foundsw = newsw;
+            return filter_occ;
         }
     }
     // another filter: flip a bit
     for(int i = 1; i < lastsw_len - 1; i++){
         u64 modsw = lastsw_bits ^ (1ull << i);
-        Word newsw = build_word(modsw, lastsw_len, swruntab);
-        u64 filter_occ = subword_cnt(w, newsw);
+        Word newsw = build_word(modsw, lastsw_len);
+        u64 filter_occ = subword_cnt(ctx, w, newsw);
         if(filter_occ > record){
-            maxrec.subwords.push_back(newsw);
-            maxrec.occ = filter_occ;
-            return maxrec;
+            *foundsw = newsw;
+            return filter_occ;
         }
     }
     // yet another filter: flip two bits
     for(int i = 1; i < lastsw_len - 2; i++){
         for(int j = i + 1; j < lastsw_len - 1; j++){
             u64 modsw = lastsw_bits ^ (1ull << i) ^ (1ull << j);
-            Word newsw = build_word(modsw, lastsw_len, swruntab);
-            u64 filter_occ = subword_cnt(w, newsw);
+            Word newsw = build_word(modsw, lastsw_len);
+            u64 filter_occ = subword_cnt(ctx, w, newsw);
             if(filter_occ > record){
-                maxrec.subwords.push_back(newsw);
-                maxrec.occ = filter_occ;
-                return maxrec;
+                *foundsw = newsw;
+                return filter_occ;
             }
         }
     }
@@ -190,23 +249,82 @@ static Rec_sw maxfreq_subword_hinted(Word w, u64 record, Word* lastsw){
         u64 bits = 0;
         while(true){
             bool contd = fibogen_next(&bits, &fbst);
-            Word newsw = build_word(bits, lastsw_len, swruntab);
-            u64 filter_occ = subword_cnt(w, newsw);
+            Word newsw = build_word(bits, lastsw_len);
+            u64 filter_occ = subword_cnt(ctx, w, newsw);
             if(filter_occ > record){
-                maxrec.subwords.push_back(newsw);
-                maxrec.occ = filter_occ;
+                *foundsw = newsw;
                 // we update here because it may change a lot
-                *lastsw = maxrec.subwords[0];
-                return maxrec;
+                *lastsw = newsw;
+                return filter_occ;
             }
             if(!contd) break;
         }
     }
+    return 0;
+}
+
+// the next subword length to check, in the most probable order around lastsw_len
+static inline int next_len(int lastsw_len, int* curdev){
+    int curk;
+    do {
+        if(*curdev < 0) 
+            *curdev = -*curdev;
+        else 
+            *curdev = -*curdev - 1;
+        curk = lastsw_len + *curdev;
+    } while (curk < 2);
+    return curk;
+}
+
+// only computes the maxocc of w, or something larger than the record if it is
+// pruned, without any allocation. It follows the same path as the function
+// below, and updates lastsw in the same way.
+static u64 maxfreq_subword_hinted_occ(Sw_ctx* ctx, Word w, u64 record, Word* lastsw, Word* prunesw){
+    Word recsw;
+    u64 maxocc = maxfreq_subword_filter(ctx, w, record, lastsw, &recsw);
+    if(maxocc){
+        *prunesw = recsw;
+        return maxocc;
+    }
+    maxocc = 1;
     // check different lengths with most probable order
+    int lastsw_len = lastsw->len;
     int curk = lastsw_len;
     int curdev = 0;
     while(true){
-        maxfreq_subword_len_hinted(&maxrec_len, curk, record);
+        u64 occ = maxfreq_subword_len_hinted_occ(ctx, w, curk, record, &recsw);
+        if(occ > maxocc){
+            maxocc = occ;
+            if(maxocc > record){
+                *lastsw = recsw;
+                *prunesw = recsw;
+                break;
+            }
+        }
+        curk = next_len(lastsw_len, &curdev);
+        if(curk == w.len - 1) break;
+    }
+    return maxocc;
+}
+
+static Rec_sw maxfreq_subword_hinted(Sw_ctx* ctx, Word w, u64 record, Word* lastsw){
+    Rec_sw maxrec = {w, std::vector<Word>(), 1};
+    Rec_sw maxrec_len = {w, std::vector<Word>(), 1};
+    int lastsw_len = lastsw->len;
+    Word filtersw;
+    // the filter cannot beat no record
+    u64 filter_occ = 0;
+    if(record != NO_RECORD) filter_occ = maxfreq_subword_filter(ctx, w, record, lastsw, &filtersw);
+    if(filter_occ){
+        maxrec.subwords.push_back(filtersw);
+        maxrec.occ = filter_occ;
+        return maxrec;
+    }
+    // check different lengths with most probable order
+    int curk = lastsw_len;
+    int curdev = 0;
+    while(true){
+        maxfreq_subword_len_hinted(ctx, &maxrec_len, curk, record);
         if(maxrec_len.occ >= maxrec.occ){
             if(maxrec_len.occ > maxrec.occ) maxrec.subwords.clear();
             maxrec.occ = maxrec_len.occ;
@@ -218,31 +336,109 @@ static Rec_sw maxfreq_subword_hinted(Word w, u64 record, Word* lastsw){
                 break;
             }
         }
-        do {
-            if(curdev < 0) 
-                curdev = -curdev;
-            else 
-                curdev = -curdev - 1;
-            curk = lastsw_len + curdev;
-        } while (curk < 2);
+        curk = next_len(lastsw_len, &curdev);
         if(curk == w.len - 1) break;
     }
     return maxrec;
 }
 
 // compute most frequent subwords for a single given word
-Rec_sw maxfreq_subword_single(Word w, u64 record){
-    Word lastsw = {0, NULL, 1, 2};
-    return maxfreq_subword_hinted(w, record, &lastsw);
+Rec_sw maxfreq_subword_single(Sw_ctx* ctx, Word w, u64 record){
+    Word lastsw = build_word(0, 2);
+    return maxfreq_subword_hinted(ctx, w, record, &lastsw);
+}
+
+// run the DFS of a unit from its prefix, the prefix is cut as in sw_dfs
+static void word_unit_eval(Sw_dfs* dfs, Word_unit* unit){
+    int p = std::min(dfs->k - 2, WORD_UNIT_BITS);
+    u64 bits = 0;
+    for(int d = 0; d <= p; d++){
+        u64 letter = (unit->prefix >> (p - d)) & 1; // the first one is 0
+        u64 total;
+        u64 bound = sw_dfs_extend(dfs, d, letter, &total);
+        if(!sw_dfs_open(dfs, bound)) return;
+        bits = (bits << 1) | letter;
+    }
+    sw_dfs(dfs, p + 1, bits);
+    return;
+}
+
+// evaluate units in order, each one starts from the maximum of the others
+static void* maxfreq_subword_mt_parallel(void* info){
+    Word_info winfo = *((Word_info*) info);
+    std::vector<Word_unit>& units = *winfo.units;
+    Sw_dfs* dfs = new Sw_dfs;
+    while(true){
+        u64 i = (*winfo.next)++;
+        if(i >= units.size()) break;
+        Word_unit* unit = &units[i];
+        sw_dfs_init(dfs, winfo.ctx, winfo.w, unit->k, ~0ULL, &unit->subwords);
+        dfs->shared = winfo.best;
+        dfs->maxocc = std::max((u64) 1, winfo.best->load());
+        word_unit_eval(dfs, unit);
+        unit->maxocc = dfs->maxocc;
+    }
+    delete dfs;
+    return NULL;
+}
+
+Rec_sw maxfreq_subword_mt(Sw_ctx* ctx, Word w){
+    Rec_sw maxrec = {w, std::vector<Word>(), 1};
+    std::vector<Word_unit> units;
+    for(int k = 2; k <= w.len - 2; k++){
+        int p = std::min(k - 2, WORD_UNIT_BITS);
+        for(u64 prefix = 0; prefix < (1ULL << p); prefix++){
+            units.push_back({k, prefix, 0, std::vector<Word>()});
+        }
+    }
+    // the middle lengths first, they have the largest counts, so that the
+    // other ones are cut early
+    int mid = w.len >> 1;
+    std::stable_sort(units.begin(), units.end(), [mid](const Word_unit& a, const Word_unit& b){
+        return abs(a.k - mid) < abs(b.k - mid);
+    });
+    std::atomic<u64> next(0), best(0);
+    Word_info winfo = {ctx, w, &units, &next, &best};
+    pthread_t thrds[THREAD_COUNT];
+    for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+        pthread_create(thrds + thread_id, NULL, maxfreq_subword_mt_parallel, &winfo);
+    }
+    for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+        pthread_join(thrds[thread_id], NULL);
+    }
+    // gather the subwords reaching the maximum, in the sequential order
+    for(const Word_unit& unit : units) maxrec.occ = std::max(maxrec.occ, unit.maxocc);
+    for(const Word_unit& unit : units){
+        if(unit.maxocc != maxrec.occ) continue;
+        maxrec.subwords.insert(maxrec.subwords.end(), unit.subwords.begin(), unit.subwords.end());
+    }
+    std::sort(maxrec.subwords.begin(), maxrec.subwords.end(), [](const Word& a, const Word& b){
+        return a.len != b.len ? a.len < b.len : a.bits < b.bits;
+    });
+    return maxrec;
+}
+
+// for metaheuristics, only the maxocc, without allocation
+u64 maxfreq_subword_hinted_fast_occ(Sw_ctx* ctx, Word w, u64 record){
+    u64 maxocc = 1;
+    Word recsw;
+    for(int curk = w.len / 4; curk < w.len / 2; curk++){
+        u64 occ = maxfreq_subword_len_hinted_occ(ctx, w, curk, record, &recsw);
+        if(occ > maxocc){
+            maxocc = occ;
+            if(maxocc > record) break;
+        }
+    }
+    return maxocc;
 }
 
 // for metaheuristics
-Rec_sw maxfreq_subword_hinted_fast(Word w, u64 record){
+Rec_sw maxfreq_subword_hinted_fast(Sw_ctx* ctx, Word w, u64 record){
     Rec_sw maxrec = {w, std::vector<Word>(), 1};
     Rec_sw maxrec_len = {w, std::vector<Word>(), 1};
     // check different lengths with most probable order
     for(int curk = w.len / 4; curk < w.len / 2; curk++){
-        maxfreq_subword_len_hinted(&maxrec_len, curk, record);
+        maxfreq_subword_len_hinted(ctx, &maxrec_len, curk, record);
         if(maxrec_len.occ >= maxrec.occ){
             if(maxrec_len.occ > maxrec.occ) maxrec.subwords.clear();
             maxrec.occ = maxrec_len.occ;
@@ -257,65 +453,677 @@ Rec_sw maxfreq_subword_hinted_fast(Word w, u64 record){
     return maxrec;
 }
 
-// test whether it is the smallest in its equivalence class
-static inline bool is_primitive(u64 bits, int len){
-    return sym_mult(bits, len) > 0;
+static inline void update_minrec(Rec_occ* minrec, Rec_sw* maxrec){
+    if(minrec->occ >= maxrec->occ){
+        if(minrec->occ > maxrec->occ){
+            minrec->recs.clear();
+        }
+        minrec->occ = maxrec->occ;
+        minrec->recs.push_back(*maxrec);
+    }
+    return;
 }
 
-static inline void update_minrec(Rec_occ* minrec, Rec_sw maxrec){
-    if(minrec->occ >= maxrec.occ){
-        if(minrec->occ > maxrec.occ){
-            minrec->recs.clear();
+// append a LEB128 varint
+static inline void cert_put(Cert_buf* cert, u64 x){
+    while(x >= 0x80){
+        cert->data[cert->size++] = (x & 0x7f) | 0x80;
+        x >>= 7;
+    }
+    cert->data[cert->size++] = x;
+    return;
+}
+
+// read a LEB128 varint at *pos, returns false past the end
+static inline bool cert_get(const unsigned char* data, u64 size, u64* pos, u64* x){
+    *x = 0;
+    for(int shift = 0; *pos < size && shift < 64; shift += 7){
+        unsigned char byte = data[(*pos)++];
+        *x |= (u64) (byte & 0x7f) << shift;
+        if(!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+// write the runs of a thread as a chunk, in one piece
+static void cert_write(Cert_buf* cert){
+    if(cert->size == 0) return;
+    u64 head[2] = {cert->thread_id, (u64) cert->size};
+    flockfile(cert->out);
+    fwrite(head, sizeof(u64), 2, cert->out);
+    fwrite(cert->data, 1, cert->size, cert->out);
+    funlockfile(cert->out);
+    cert->size = 0;
+    return;
+}
+
+// encode the last run
+static void cert_flush(Cert_buf* cert){
+    if(cert->cnt == 0) return;
+    if(cert->size + CERT_RUN_BYTES > CERT_CHUNK) cert_write(cert);
+    cert_put(cert, cert->sw);
+    cert_put(cert, cert->cnt);
+    cert->cnt = 0;
+    return;
+}
+
+// add the subword certifying the next word, merged with the last run if equal
+static inline void cert_add(Cert_buf* cert, Word sw){
+    u64 code = (1ULL << sw.len) | sw.bits;
+    if(cert->cnt > 0 && cert->sw == code){
+        cert->cnt++;
+        return;
+    }
+    cert_flush(cert);
+    cert->sw = code;
+    cert->cnt = 1;
+    return;
+}
+
+// words pruned by the table of maxocc in this thread, see oracle_collect
+static thread_local u64 oracle_pruned = 0;
+
+// index in the table of maxocc of a word of m bits, up to complement
+static inline u64 oracle_index(u64 bits, int m){
+    if(bits >> (m - 1)) bits ^= low_mask(m);
+    return bits;
+}
+
+// whether a factor of w has a maxocc above the record in the table
+static inline bool oracle_prunes(Sw_ctx* ctx, Word w, u64 record){
+    int m = ctx->oracle_len;
+    if(ctx->oracle == NULL || w.len < m) return false;
+    // the lookups are independent, so that their misses overlap
+    for(int i = 0; i + m <= w.len; i++){
+        __builtin_prefetch(ctx->oracle + oracle_index((w.bits >> i) & low_mask(m), m));
+    }
+    for(int i = 0; i + m <= w.len; i++){
+        if(ctx->oracle[oracle_index((w.bits >> i) & low_mask(m), m)] > record){
+            oracle_pruned++;
+            return true;
         }
-        minrec->occ = maxrec.occ;
-        minrec->recs.push_back(maxrec);
     }
+    return false;
+}
+
+// add the words pruned by the table in the calling thread to the context
+static void oracle_collect(Sw_ctx* ctx){
+    ctx->oracle_pruned += oracle_pruned;
+    oracle_pruned = 0;
+    return;
+}
+
+// evaluate a word in the exhaustive search: the full record (with allocations)
+// is only built for words that tie or beat the record, which are rare
+// the subword pruning the word, or one of its most frequent, goes to cert
+static inline void eval_word_hinted(Sw_ctx* ctx, Rec_occ* minrec, Word w, u64 record, Word* lastsw, Cert_buf* cert){
+    Word prunesw;
+    if(cert == NULL && oracle_prunes(ctx, w, record)) return;
+    if(maxfreq_subword_hinted_occ(ctx, w, record, lastsw, &prunesw) > record){
+        if(cert) cert_add(cert, prunesw);
+        return;
+    }
+    Rec_sw maxrec = maxfreq_subword_hinted(ctx, w, record, lastsw);
+    update_minrec(minrec, &maxrec);
+    // a word is its own subword, in case there is no other
+    if(cert) cert_add(cert, maxrec.subwords.empty() ? w : maxrec.subwords[0]);
     return;
 }
 
+Order_gen order_gen_new(Sw_ctx* ctx, int len, u64 fixed_mask, u64 fixed){
+    Order_gen gen;
+    gen.gen = canon_gen_new(len, fixed_mask, fixed, 0, 0);
+    gen.fixed_mask = fixed_mask;
+    gen.fixed = fixed;
+    gen.next = 0;
+    gen.block_start = false;
+    // the highest free bits make the blocks, fewer for short words
+    u64 free_mask = gen.gen.free_mask;
+    int free_cnt = std::popcount(free_mask);
+    int order_bits = std::min(ORDER_BITS, free_cnt / 2);
+    gen.block_size = 1ULL << (free_cnt - order_bits);
+    int low = std::countr_zero(deposit_bits(gen.block_size, free_mask | (1ULL << (len - 1))));
+    std::vector<std::pair<u64, u64>> scores;
+    for(u64 start = 0; start < gen.gen.end; start += gen.block_size){
+        u64 bits = deposit_bits(start, free_mask) | gen.gen.fixed;
+        scores.push_back({maxfreq_subword(ctx, build_word(bits >> low, len - low)), start});
+    }
+    std::sort(scores.begin(), scores.end());
+    for(const auto& [score, start] : scores) gen.blocks.push_back(start);
+    gen.gen.end = 0; // the first block is taken by order_next
+    return gen;
+}
+
+bool order_next(Order_gen* gen){
+    gen->block_start = false;
+    while(!canon_next(&gen->gen)){
+        if(gen->next >= gen->blocks.size()) return false;
+        u64 start = gen->blocks[gen->next++];
+        gen->gen = canon_gen_new(gen->gen.w.len, gen->fixed_mask, gen->fixed, start, start + gen->block_size);
+        gen->block_start = true;
+    }
+    return true;
+}
+
+// the words of a record in binary order, and their subwords by length then
+// in binary order, so that they do not depend on the order of the search
+static void sort_recs(Rec_occ* minrec){
+    std::sort(minrec->recs.begin(), minrec->recs.end(), [](const Rec_sw& a, const Rec_sw& b){
+        return a.word.bits < b.word.bits;
+    });
+    for(Rec_sw& rec : minrec->recs){
+        std::sort(rec.subwords.begin(), rec.subwords.end(), [](const Word& a, const Word& b){
+            return a.len != b.len ? a.len < b.len : a.bits < b.bits;
+        });
+    }
+    return;
+}
+
+// lower the record of the search to the one of the caller if it is better,
+// returns the best of both
+static inline u64 record_share(Sw_ctx* ctx, u64 record){
+    u64 live = ctx->live_record.load(std::memory_order_relaxed);
+    while(record < live && !ctx->live_record.compare_exchange_weak(live, record));
+    return std::min(record, live);
+}
+
+// poll the file of hints until stopped, a smaller number is the new record
+static void* hint_watch_run(void* info){
+    Hint_watch* watch = (Hint_watch*) info;
+    Sw_ctx* ctx = watch->ctx;
+    while(!watch->stop){
+        FILE* in = fopen(ctx->hint_file, "r");
+        unsigned long hint = 0;
+        if(in != NULL){
+            if(fscanf(in, "%lu", &hint) != 1) hint = 0;
+            fclose(in);
+        }
+        u64 live = ctx->live_record;
+        while(hint > 0 && hint < live && !ctx->live_record.compare_exchange_weak(live, hint));
+        if(hint > 0 && hint < live && ctx->log){
+            time_t mytime = time(NULL);
+            fprintf(ctx->log, "Record lowered from %lu to %lu by %s at %s", live, hint, ctx->hint_file, ctime(&mytime));
+        }
+        usleep(HINT_POLL_MS * 1000);
+    }
+    return NULL;
+}
+
+// start the search with the given record, watching the file of hints
+static Hint_watch* search_start(Sw_ctx* ctx, u64 record){
+    ctx->live_record = record;
+    if(ctx->hint_file == NULL) return NULL;
+    Hint_watch* watch = new Hint_watch;
+    watch->ctx = ctx;
+    watch->stop = false;
+    pthread_create(&watch->thread, NULL, hint_watch_run, watch);
+    return watch;
+}
+
+// stop watching, and drop the words above a record lowered from outside
+static void search_end(Sw_ctx* ctx, Hint_watch* watch, Rec_occ* minrec){
+    if(watch != NULL){
+        watch->stop = true;
+        pthread_join(watch->thread, NULL);
+        delete watch;
+    }
+    if(minrec->occ > ctx->live_record){
+        minrec->occ = ctx->live_record;
+        minrec->recs.clear();
+    }
+    return;
+}
+
+// a hint of at least 2^n prunes nothing, as no record
+static inline u64 search_record(int n, u64 record){
+    return (n >= 64 || record < (1ULL << n)) ? record : NO_RECORD;
+}
+
 // exhaustive search with a hint
-Rec_occ min_maxfreq_subword_hinted(int n, u64 record){
-    // construct the word
-    Runtab wruns;
-    Word w = build_word(0, n, wruns);
-    Word lastsw = {0, NULL, 1, 2};
+Rec_occ min_maxfreq_subword_hinted(Sw_ctx* ctx, int n, u64 record){
+    record = search_record(n, record);
+    // only the canonical words, the most promising first
+    Order_gen gen = order_gen_new(ctx, n, 0, 0);
+    Word lastsw = build_word(0, 2);
     // initialize the records
     Rec_occ minrec;
     minrec.occ = record;
     minrec.recs = std::vector<Rec_sw>();
-    do {
-        if(!is_primitive(w.bits, n)) continue; // only test primitive ones
-        update_minrec(&minrec, maxfreq_subword_hinted(w, record, &lastsw));
-        record = minrec.occ;
-    } while(increment_word(&w));
+    Hint_watch* watch = search_start(ctx, record);
+    while(order_next(&gen)){
+        // the filter starts afresh in each block, whatever the order
+        if(gen.block_start) lastsw = build_word(0, 2);
+        eval_word_hinted(ctx, &minrec, gen.gen.w, record, &lastsw, NULL);
+        record = record_share(ctx, minrec.occ);
+    }
+    search_end(ctx, watch, &minrec);
+    sort_recs(&minrec);
+    l1_stats_collect(ctx);
+    oracle_collect(ctx);
     return minrec;
 }
 
+// evaluate words in order as in the exhaustive search, with a fixed record
+u64 eval_words_hinted(Sw_ctx* ctx, const Word* words, u64 cnt, u64 record){
+    if(cnt > 0) record = search_record(words[0].len, record);
+    Rec_occ minrec;
+    minrec.occ = record;
+    Word lastsw = build_word(0, 2);
+    for(u64 i = 0; i < cnt; i++){
+        eval_word_hinted(ctx, &minrec, words[i], record, &lastsw, NULL);
+    }
+    oracle_collect(ctx);
+    return minrec.recs.size();
+}
+
 // exhaustive search with a hint, parallel version
 void* min_maxfreq_subword_hinted_parallel(void* info){
     // get information
     Thread_info tinfo = *((Thread_info*) info);
+    Sw_ctx* ctx = tinfo.ctx;
     int n = tinfo.n;
     int tid = tinfo.thread_id;
     u64 record = tinfo.record;
-    // construct the word
-    Runtab wruns;
-    Word w = build_word(0, n, wruns);
+    cache_bind_replica(ctx, tid);
+    // the canonical words with the thread id on the bits from the middle
     int segstart = n >> 1;
+    Order_gen gen = order_gen_new(ctx, n, (u64) (THREAD_COUNT - 1) << segstart, (u64) tid << segstart);
     // initialize the records
     tinfo.minrec->occ = record;
     tinfo.minrec->recs = std::vector<Rec_sw>();
-    Word lastsw = {0, NULL, 1, 2};
-    bool has_next = true; // there are still words to check
-    do {
-        if(((w.bits >> segstart) & (THREAD_COUNT - 1)) == tid
-            && is_primitive(w.bits, n)){ // only test primitive ones
-            update_minrec(tinfo.minrec, maxfreq_subword_hinted(w, record, &lastsw));
-            record = tinfo.minrec->occ;
-        }
-    } while(increment_word(&w));
+    Word lastsw = build_word(0, 2);
+    Cert_buf* cert = NULL;
+    if(tinfo.cert != NULL){
+        cert = new Cert_buf;
+        cert->out = tinfo.cert;
+        cert->thread_id = tid;
+        cert->cnt = 0;
+        cert->size = 0;
+    }
+    while(order_next(&gen)){
+        if(gen.block_start) lastsw = build_word(0, 2);
+        eval_word_hinted(ctx, tinfo.minrec, gen.gen.w, record, &lastsw, cert);
+        // the records of the other threads prune this one too
+        record = record_share(ctx, tinfo.minrec->occ);
+    }
+    sort_recs(tinfo.minrec);
+    if(cert != NULL){
+        cert_flush(cert);
+        cert_write(cert);
+        delete cert;
+    }
+    l1_stats_collect(ctx);
+    oracle_collect(ctx);
     // measure the time
     time_t mytime = time(NULL);
-    printf("Thread %d finished at %s", tid, ctime(&mytime));
+    if(ctx->log) fprintf(ctx->log, "Thread %d finished at %s", tid, ctime(&mytime));
+    return NULL;
+}
+
+// exhaustive search with a hint, on THREAD_COUNT threads
+Rec_occ min_maxfreq_subword_hinted_mt(Sw_ctx* ctx, int n, u64 record, FILE* cert){
+    Rec_occ minrecs[THREAD_COUNT];
+    Thread_info thread_info[THREAD_COUNT];
+    pthread_t thrds[THREAD_COUNT];
+    record = search_record(n, record);
+    // set parallel mode, freeze the cache
+    set_parallel_mode(ctx);
+    Hint_watch* watch = search_start(ctx, record);
+    if(cert != NULL){
+        u64 head[3] = {CERT_MAGIC, (u64) n, THREAD_COUNT};
+        fwrite(head, sizeof(u64), 3, cert);
+    }
+    // create threads
+    for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+        thread_info[thread_id].ctx = ctx;
+        thread_info[thread_id].n = n;
+        thread_info[thread_id].thread_id = thread_id;
+        thread_info[thread_id].record = record;
+        thread_info[thread_id].minrec = minrecs + thread_id;
+        thread_info[thread_id].cert = cert;
+        pthread_create(thrds + thread_id, NULL, min_maxfreq_subword_hinted_parallel, thread_info + thread_id);
+    }
+    // collect all threads
+    for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+        pthread_join(thrds[thread_id], NULL);
+    }
+    // get the best record
+    Rec_occ minrec;
+    minrec.occ = minrecs[0].occ;
+    for(int i = 0; i < THREAD_COUNT; i++){
+        if(minrec.occ > minrecs[i].occ){
+            minrec.occ = minrecs[i].occ;
+        }
+    }
+    for(int i = 0; i < THREAD_COUNT; i++){
+        if(minrecs[i].occ != minrec.occ) continue;
+        minrec.recs.insert(minrec.recs.end(), minrecs[i].recs.begin(), minrecs[i].recs.end());
+    }
+    search_end(ctx, watch, &minrec);
+    if(cert != NULL){
+        u64 tail[2] = {CERT_END, minrec.occ};
+        fwrite(tail, sizeof(u64), 2, cert);
+        fflush(cert);
+    }
+    return minrec;
+}
+
+// check the certificates of a thread, the words are generated in the same
+// order as in the search
+static void* cert_verify_parallel(void* info){
+    Cert_info* cinfo = (Cert_info*) info;
+    cache_bind_replica(cinfo->ctx, cinfo->thread_id);
+    int n = cinfo->n;
+    int segstart = n >> 1;
+    Order_gen gen = order_gen_new(cinfo->ctx, n, (u64) (cinfo->threads - 1) << segstart, (u64) cinfo->thread_id << segstart);
+    FILE* in = fopen(cinfo->path, "rb");
+    cinfo->minocc = ~0ULL;
+    cinfo->words = 0;
+    cinfo->valid = (in != NULL);
+    unsigned char* data = new unsigned char[CERT_CHUNK];
+    for(size_t i = 0; cinfo->valid && i < cinfo->chunks->size(); i++){
+        u64 head[2];
+        fseek(in, (*cinfo->chunks)[i], SEEK_SET);
+        if(fread(head, sizeof(u64), 2, in) != 2 || head[1] > CERT_CHUNK
+           || fread(data, 1, head[1], in) != head[1]){
+            cinfo->valid = false;
+            break;
+        }
+        u64 pos = 0;
+        while(cinfo->valid && pos < head[1]){
+            u64 code, cnt;
+            if(!cert_get(data, head[1], &pos, &code) || !cert_get(data, head[1], &pos, &cnt)){
+                cinfo->valid = false;
+                break;
+            }
+            int len = 63 - std::countl_zero(code);
+            if(len < 1 || len > n){
+                cinfo->valid = false;
+                break;
+            }
+            Word sw = build_word(code ^ (1ULL << len), len);
+            for(u64 k = 0; k < cnt; k++){
+                if(!order_next(&gen)){ // more certificates than words
+                    cinfo->valid = false;
+                    break;
+                }
+                u64 occ = subword_cnt(cinfo->ctx, gen.gen.w, sw);
+                if(occ < cinfo->minocc) cinfo->minocc = occ;
+                cinfo->words++;
+            }
+        }
+    }
+    // all the words should be certified
+    if(cinfo->valid && order_next(&gen)) cinfo->valid = false;
+    delete[] data;
+    if(in != NULL) fclose(in);
+    l1_stats_collect(cinfo->ctx);
     return NULL;
+}
+
+// check a certificate file on as many threads as the search
+u64 cert_verify(Sw_ctx* ctx, int n, const char* path, u64* claimed){
+    FILE* in = fopen(path, "rb");
+    if(in == NULL) return 0;
+    // index the chunks of each thread
+    u64 head[3];
+    if(fread(head, sizeof(u64), 3, in) != 3 || head[0] != CERT_MAGIC || head[1] != (u64) n
+       || head[2] == 0 || head[2] > 1024 || (head[2] & (head[2] - 1))){
+        fclose(in);
+        return 0;
+    }
+    int threads = head[2];
+    std::vector<std::vector<long>> chunks(threads);
+    bool complete = false;
+    while(fread(head, sizeof(u64), 2, in) == 2){
+        if(head[0] == CERT_END){
+            *claimed = head[1];
+            complete = true;
+            break;
+        }
+        if(head[0] >= (u64) threads || head[1] > CERT_CHUNK) break;
+        chunks[head[0]].push_back(ftell(in) - 2 * sizeof(u64));
+        if(fseek(in, head[1], SEEK_CUR) != 0) break;
+    }
+    fclose(in);
+    if(!complete) return 0;
+    // check the threads in parallel
+    set_parallel_mode(ctx);
+    std::vector<Cert_info> cert_info(threads);
+    std::vector<pthread_t> thrds(threads);
+    for(int thread_id = 0; thread_id < threads; thread_id++){
+        cert_info[thread_id] = {ctx, path, n, threads, thread_id, &chunks[thread_id], 0, 0, false};
+        pthread_create(&thrds[thread_id], NULL, cert_verify_parallel, &cert_info[thread_id]);
+    }
+    u64 minocc = ~0ULL;
+    bool valid = true;
+    for(int thread_id = 0; thread_id < threads; thread_id++){
+        pthread_join(thrds[thread_id], NULL);
+        valid = valid && cert_info[thread_id].valid;
+        if(cert_info[thread_id].minocc < minocc) minocc = cert_info[thread_id].minocc;
+    }
+    return valid ? minocc : 0;
+}
+
+// the maxocc of the canonical words of a thread, for the word and its
+// reversal, the complements share the entries
+static void* oracle_build_parallel(void* info){
+    Oracle_info oinfo = *((Oracle_info*) info);
+    int m = oinfo.m;
+    int segstart = m >> 1;
+    Canon_gen gen = canon_gen_new(m, (u64) (THREAD_COUNT - 1) << segstart, (u64) oinfo.thread_id << segstart, 0, 0);
+    while(canon_next(&gen)){
+        u64 occ = std::min(maxfreq_subword(oinfo.ctx, gen.w), (u64) UINT16_MAX);
+        oinfo.table[oracle_index(gen.w.bits, m)] = occ;
+        oinfo.table[oracle_index(reverse_bits(gen.w.bits, m), m)] = occ;
+    }
+    return NULL;
+}
+
+bool oracle_build(Sw_ctx* ctx, int m, const char* path){
+    if(m < 8 || m > ORACLE_MAXLEN) return false;
+    FILE* out = fopen(path, "wb");
+    if(out == NULL) return false;
+    u64 size = 1ULL << (m - 1);
+    uint16_t* table = new uint16_t[size];
+    Oracle_info oracle_info[THREAD_COUNT];
+    pthread_t thrds[THREAD_COUNT];
+    // subwords are counted in the words, so the cache is not used
+    for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+        oracle_info[thread_id] = {ctx, m, thread_id, table};
+        pthread_create(thrds + thread_id, NULL, oracle_build_parallel, oracle_info + thread_id);
+    }
+    for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+        pthread_join(thrds[thread_id], NULL);
+    }
+    u64 head[2] = {ORACLE_MAGIC, (u64) m};
+    bool ok = fwrite(head, sizeof(u64), 2, out) == 2;
+    ok = ok && fwrite(table, sizeof(uint16_t), size, out) == size;
+    ok = (fclose(out) == 0) && ok;
+    delete[] table;
+    return ok;
+}
+
+bool oracle_load(Sw_ctx* ctx, const char* path){
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if(fstat(fd, &st) == 0 && st.st_size >= (off_t) (2 * sizeof(u64))){
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if(map == MAP_FAILED) return false;
+    const u64* head = (const u64*) map;
+    int m = head[1];
+    if(head[0] != ORACLE_MAGIC || m < 8 || m > ORACLE_MAXLEN
+       || (u64) st.st_size != 2 * sizeof(u64) + (sizeof(uint16_t) << (m - 1))){
+        munmap(map, st.st_size);
+        return false;
+    }
+    // the probes are scattered, no read-ahead
+    madvise(map, st.st_size, MADV_RANDOM);
+    if(ctx->oracle_map != NULL) munmap(ctx->oracle_map, ctx->oracle_bytes);
+    ctx->oracle_map = map;
+    ctx->oracle_bytes = st.st_size;
+    ctx->oracle = (const uint16_t*) (head + 2);
+    ctx->oracle_len = m;
+    return true;
+}
+
+// enumerate the distinct subwords of w with the same ends as w, with the first
+// letters in sw, embedded as early as possible with w used up to the bit pos
+// the leftmost embedding is unique, so each subword is met only once
+static void warm_subwords(Sw_ctx* ctx, Word w, Word sw, int pos, std::vector<Warm_pair>* found){
+    // a single run is never looked up in the cache
+    if(sw.runcnt > 1 && (sw.bits & 1) == (w.bits & 1)){
+        found->push_back({w, sw, subword_cnt(ctx, w, sw)});
+    }
+    for(u64 letter = 0; letter < 2; letter++){
+        u64 avail = (letter ? w.bits : ~w.bits) & low_mask(pos + 1);
+        if(avail == 0) continue;
+        Word newsw = sw;
+        add_bit(&newsw, letter);
+        warm_subwords(ctx, w, newsw, 62 - std::countl_zero(avail), found);
+    }
+    return;
+}
+
+// compute the pairs of the given length for the warm-up, the cache is read only
+static void* warm_cache_parallel(void* info){
+    Warm_info winfo = *((Warm_info*) info);
+    int len = winfo.len;
+    for(u64 bits = winfo.thread_id; bits < (1ULL << len); bits += THREAD_COUNT){
+        Word w = build_word(bits, len);
+        if(w.runcnt < 2 || w.runcnt >= winfo.ctx->max_cache_run) continue;
+        Word sw = build_word(bits >> (len - 1), 1);
+        warm_subwords(winfo.ctx, w, sw, len - 2, winfo.found);
+    }
+    l1_stats_collect(winfo.ctx);
+    return NULL;
+}
+
+// fill the cache from short to long, so that the counts of a given length only
+// need those of the shorter ones, which are already in the cache
+// threads only read the cache, the insertion is done after each length
+void warm_cache_pairs(Sw_ctx* ctx, int maxlen){
+    std::vector<Warm_pair> found[THREAD_COUNT];
+    Warm_info warm_info[THREAD_COUNT];
+    pthread_t thrds[THREAD_COUNT];
+    int mask = ctx->parallel_mask;
+    set_parallel_mode(ctx);
+    u64 total = 0;
+    for(int len = ctx->warm_len + 1; len <= maxlen; len++){
+        for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+            warm_info[thread_id].ctx = ctx;
+            warm_info[thread_id].len = len;
+            warm_info[thread_id].thread_id = thread_id;
+            warm_info[thread_id].found = found + thread_id;
+            pthread_create(thrds + thread_id, NULL, warm_cache_parallel, warm_info + thread_id);
+        }
+        // all threads should be done before the cache is modified
+        for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+            pthread_join(thrds[thread_id], NULL);
+        }
+        u64 cnt = 0;
+        for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+            for(auto pair : found[thread_id]) cache_insert(ctx, pair.w, pair.sw, pair.cnt);
+            cnt += found[thread_id].size();
+            found[thread_id].clear();
+            found[thread_id].shrink_to_fit();
+        }
+        total += cnt;
+        if(ctx->log){
+            fprintf(ctx->log, "Warm-up: length %d/%d, %lu pairs, %lu in total\n", len, maxlen, cnt, total);
+            fflush(ctx->log);
+        }
+    }
+    if(maxlen > ctx->warm_len) ctx->warm_len = maxlen;
+    ctx->parallel_mask = mask;
+    return;
+}
+
+// 95% confidence interval (Wilson score), also fine for small counts
+void sample_interval(u64 cnt, u64 total, double* low, double* high){
+    const double z = 1.96;
+    double p = (double) cnt / total;
+    double denom = 1 + z * z / total;
+    double center = (p + z * z / (2 * total)) / denom;
+    double half = z * sqrt(p * (1 - p) / total + z * z / (4.0 * total * total)) / denom;
+    *low = center - half;
+    *high = center + half;
+    return;
+}
+
+// evaluate the words of a round in order, until the deadline
+static void* maxfreq_subword_sample_parallel(void* info){
+    Sample_info sinfo = *((Sample_info*) info);
+    while(true){
+        if(sinfo.deadline && time(NULL) >= sinfo.deadline) break;
+        int i = (*sinfo.next)++;
+        if(i >= SAMPLE_ROUND) break;
+        sinfo.occs[i] = maxfreq_subword(sinfo.ctx, sinfo.words[i]);
+        sinfo.done[i] = 1;
+    }
+    l1_stats_collect(sinfo.ctx);
+    return NULL;
+}
+
+// largest half-width of the confidence intervals of the histogram
+static double sample_precision(Histogram* histo, u64 total){
+    double worst = 0;
+    for(const auto& [freq, cnt] : *histo){
+        double low, high;
+        sample_interval(cnt, total, &low, &high);
+        if((high - low) / 2 > worst) worst = (high - low) / 2;
+    }
+    return worst;
+}
+
+// estimated histogram, by rounds of SAMPLE_ROUND words
+Histogram maxfreq_subword_sample(Sw_ctx* ctx, int n, u64 seed, double precision, double seconds){
+    Word words[SAMPLE_ROUND];
+    u64 occs[SAMPLE_ROUND];
+    char done[SAMPLE_ROUND];
+    std::atomic<int> next;
+    Sample_info sample_info;
+    pthread_t thrds[THREAD_COUNT];
+    Histogram histo = Histogram();
+    u64 state = seed;
+    u64 total = 0;
+    time_t start = time(NULL);
+    time_t last_log = start;
+    set_parallel_mode(ctx);
+    while(true){
+        // draw the words, the first letter is always 0
+        for(int i = 0; i < SAMPLE_ROUND; i++){
+            words[i] = build_word(random_next(&state) & low_mask(n - 1), n);
+            done[i] = 0;
+        }
+        next = 0;
+        sample_info = {ctx, words, occs, done, &next, seconds > 0 ? start + (time_t) ceil(seconds) : 0};
+        for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+            pthread_create(thrds + thread_id, NULL, maxfreq_subword_sample_parallel, &sample_info);
+        }
+        for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+            pthread_join(thrds[thread_id], NULL);
+        }
+        // only keep the words before the first one not evaluated
+        int cnt = 0;
+        while(cnt < SAMPLE_ROUND && done[cnt]) histo[occs[cnt++]]++;
+        total += cnt;
+        if(total == 0) break; // not even one word in time
+        // stopping conditions
+        double cur = sample_precision(&histo, total);
+        double elapsed = difftime(time(NULL), start);
+        bool stop = cnt < SAMPLE_ROUND || cur <= precision || (seconds > 0 && elapsed >= seconds);
+        // progress at most once per second
+        if(ctx->log && (stop || time(NULL) != last_log)){
+            last_log = time(NULL);
+            fprintf(ctx->log, "Sampled %lu words in %.0fs, precision %.5f\n", total, elapsed, cur);
+            fflush(ctx->log);
+        }
+        if(stop) break;
+    }
+    return histo;
 }
\ No newline at end of file
@@ -22,25 +22,50 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include "swcnt.hpp"
-#include "swexhaust.hpp"
-#include "swutils.hpp"
-#include "swmeta.hpp"
+#include "maxocc.hpp"
+#include "swserver.hpp"
+#include "swcli.hpp"
 
 /*
-Four modes of operations:
+Nine modes of operations:
 
 1. Finding words with minimal maxocc of subwords using hinted exhaustive search
+   (with a certificate of the result, checked by the verify mode)
 2. Metaheuristic search to obtain reasonable hint
 3. Histogram of maxocc of subwords
+   (or its estimation by sampling for large n)
 4. Compute (an underestimation of) the best maxocc of "increments" of a given word by inserting a bit
+   (or the exact best maxocc of a beam search inserting bits in several words)
+5. Compute the maxocc of many words given in a file, in batch
+6. Server answering queries of the modes above on a socket, with the cache kept in memory
+7. Campaign of exhaustive searches for several n, each hinted by the insertion heuristic on the previous one
+8. Tuning of the cache parameters for a given n, saved in a profile used by the other modes
+   (and the comparison of the engines counting subword occurrences)
+9. Table of maxocc of all the words of a given length, pruning the exhaustive search
 */
 
+// whether to copy the cache on each NUMA node: asked by MAXOCC_NUMA, and
+// useful only if the engines read the cache
+static bool numa_wanted(const char* numa, Sw_ctx* ctx, int n){
+    if(numa == NULL || !atoi(numa)) return false;
+    if(cache_engine_used(ctx, n)) return true;
+    if(ctx->log) fprintf(ctx->log, "MAXOCC_NUMA ignored, the cache is not used with %d bits\n", n);
+    return false;
+}
+
 int main(int argc, char** argv){
-    binom_precompute();
-    
+    // in batch mode, stdout is reserved for the results
+    FILE* info = (argc >= 3 && strcmp(argv[2], "batch") == 0) ? stderr : stdout;
+    Sw_ctx* ctx = sw_ctx_new(info);
+    // memory budget of the cache in GB, for shared nodes
+    char* budget = getenv("MAXOCC_CACHE_GB");
+    if(budget != NULL) set_cache_budget(ctx, atof(budget) * (1ULL << 30));
+    // copies of the cache on each NUMA node for the parallel search
+    char* numa = getenv("MAXOCC_NUMA");
+    // file of better hints found while the exhaustive search runs
+    char* hintfile = getenv("MAXOCC_HINT_FILE");
     time_t mytime = time(NULL);
-    printf("%s", ctime(&mytime));
+    fprintf(info, "%s", ctime(&mytime));
     if(argc <= 1){
         printf("Needs at least the number of bits\n");
         return 0;
@@ -50,27 +75,82 @@ int main(int argc, char** argv){
         printf("Invalid argument, the number of bits is between 1 and 64\n");
     }
     
+    // the tuning profile, written by the autotune mode
+    char* tune = getenv("MAXOCC_TUNE");
+    if(tune == NULL) tune = (char*) TUNE_FILE;
+    if(argc < 3 || strcmp(argv[2], "autotune") != 0) load_tuning(ctx, n, tune);
+    // the table of maxocc of short words, written by the oracle mode
+    char* oracle = getenv("MAXOCC_ORACLE");
+    if(oracle != NULL && oracle[0] && (argc < 3 || strcmp(argv[2], "oracle") != 0)){
+        if(oracle_load(ctx, oracle)){
+            fprintf(info, "Loaded the table of maxocc of %d bits\n", ctx->oracle_len);
+        }else{
+            fprintf(info, "Cannot load the table of maxocc %s\n", oracle);
+        }
+    }
+
     u64 hint = 0;
     bool computed = false;
     if(argc >= 3){
         if(strcmp(argv[2], "histo") == 0){
             printf("Producing histogram for maxocc with %d bits.\n", n);
-            histo_subword(n);
+            histo_subword(ctx, n);
+            computed = true;
+        }else if(strcmp(argv[2], "sample") == 0){
+            // time budget in seconds, target precision, seed
+            double seconds = (argc < 4) ? 60 : atof(argv[3]);
+            double precision = (argc < 5) ? 0.001 : atof(argv[4]);
+            u64 seed = (argc < 6) ? 1 : strtoull(argv[5], NULL, 10);
+            printf("Sampling histogram for maxocc with %d bits.\n", n);
+            sample_histo_subword(ctx, n, seed, precision, seconds);
+            computed = true;
+        }else if(strcmp(argv[2], "meta") == 0 && argc >= 4
+                 && (strcmp(argv[3], "sa") == 0 || strcmp(argv[3], "tabu") == 0)){
+            // engines with a budget of CPU seconds, seed, then their parameters
+            Meta_params params = meta_params_default((argc < 5) ? 60 : atof(argv[4]),
+                                                     (argc < 6) ? 1 : strtoull(argv[5], NULL, 10));
+            Rec_sw rec;
+            if(strcmp(argv[3], "sa") == 0){
+                if(argc >= 7) params.temp = atof(argv[6]);
+                if(argc >= 8) params.cooling = atof(argv[7]);
+                printf("Simulated annealing for hint with %d bits.\n", n);
+                rec = simulated_annealing(ctx, n, &params);
+            }else{
+                if(argc >= 7) params.tenure = atoi(argv[6]);
+                printf("Tabu search for hint with %d bits.\n", n);
+                rec = tabu_search(ctx, n, &params);
+            }
+            print_record(&rec);
+            computed = true;
+        }else if(strcmp(argv[2], "meta") == 0 && argc >= 4 && strcmp(argv[3], "compare") == 0){
+            double seconds = (argc < 5) ? 10 : atof(argv[4]);
+            int seedcnt = (argc < 6) ? 3 : atoi(argv[5]);
+            printf("Comparison of metaheuristics for hint with %d bits.\n", n);
+            meta_compare(ctx, n, seconds, seedcnt);
             computed = true;
         }else if(strcmp(argv[2], "meta") == 0){
             if(argc <= 5){
                 printf("Insufficient arguments.\n");
                 printf("Needs exhaustive search radius, max sampling number.");
             }
+            // local searches on all threads, with the same result or not
+            // they count through the subwords directly, the cache is not read
+            if(argc >= 6 && strncmp(argv[5], "mt", 2) == 0){
+                set_parallel_mode(ctx);
+                ctx->search_threads = THREAD_COUNT;
+                ctx->deterministic = strcmp(argv[5], "mt-race") != 0;
+            }
             printf("Metaheuristic search for hint with with %d bits.\n", n);
-            mixed_descent(n, atoi(argv[3]), atoi(argv[4]));
+            Rec_sw best = mixed_descent(ctx, n, atoi(argv[3]), atoi(argv[4]), time(NULL));
+            printf("Best verified maxocc %lu: ", best.occ);
+            print_record(&best);
             computed = true;
         }else if(strcmp(argv[2], "word") == 0){
             if(argc < 4 || strlen(argv[3]) != n){
                 printf("Invalid argument for the word.\n");
             }else{
                 printf("Maxocc for single word.\n");
-                compute_maxfreq_subword(argv[3]);
+                compute_maxfreq_subword(ctx, argv[3]);
             }
             computed = true;
         }else if(strcmp(argv[2], "insert") == 0){
@@ -78,20 +158,92 @@ int main(int argc, char** argv){
                 printf("Invalid argument for the word.\n");
             }else{
                 printf("Heuristic by inserting a bit.\n");
-                insert_heuristic(argv[3]);
+                insert_heuristic(ctx, argv[3]);
             }
             computed = true; 
+        }else if(strcmp(argv[2], "beam") == 0){
+            bool valid = argc >= 5 && atoi(argv[3]) > 0;
+            for(int i = 4; i < argc && valid; i++){
+                valid = strlen(argv[i]) == strlen(argv[4]) && (int) strlen(argv[i]) < n;
+            }
+            if(!valid){
+                printf("Needs the beam width and words of the same length, shorter than %d.\n", n);
+            }else{
+                printf("Beam search by inserting bits.\n");
+                insert_beam_search(ctx, n, atoi(argv[3]), argv + 4, argc - 4);
+            }
+            computed = true;
+        }else if(strcmp(argv[2], "batch") == 0){
+            FILE* in = stdin;
+            if(argc >= 4 && strcmp(argv[3], "-") != 0) in = fopen(argv[3], "r");
+            if(in == NULL){
+                fprintf(info, "Cannot open %s.\n", argv[3]);
+            }else{
+                fprintf(info, "Maxocc for words with %d bits in batch.\n", n);
+                batch_maxfreq_subword(ctx, n, in, stdout);
+                if(in != stdin) fclose(in);
+            }
+            computed = true;
+        }else if(strcmp(argv[2], "server") == 0){
+            if(argc < 4){
+                printf("Needs the path of the socket.\n");
+            }else{
+                printf("Server for words with %d bits.\n", n);
+                serve_queries(ctx, argv[3]);
+            }
+            computed = true;
+        }else if(strcmp(argv[2], "campaign") == 0){
+            FILE* out = (argc < 5) ? NULL : fopen(argv[4], "a");
+            if(out == NULL){
+                printf("Needs the last number of bits and a writable result file.\n");
+            }else{
+                int nmax = atoi(argv[3]);
+                hint = (argc < 6) ? NO_RECORD : atoi(argv[5]);
+                printf("Campaign for words with %d to %d bits.\n", n, nmax);
+                campaign(ctx, n, nmax, hint, out);
+                fclose(out);
+            }
+            computed = true;
         }else if(strcmp(argv[2], "mt") == 0){
-            hint = (argc < 4) ? (1ULL << n) : atoi(argv[3]);
-            // first, fill the cache in with histo
-            int cachebit = 2 + (n >> 1);
-            if(cachebit > 20) cachebit = 20; // takes 10GB memory
-            maxfreq_subword_histo(cachebit); // throw away the result!
+            hint = (argc < 4) ? NO_RECORD : atoi(argv[3]);
+            // first, fill the cache, with a copy on each NUMA node if asked
+            // and if the engines read the cache at all
+            warm_cache(ctx, n);
+            bool replicate = numa_wanted(numa, ctx, n);
+            if(replicate) cache_replicate(ctx);
             printf("Finished precomputing\n");
             mytime = time(NULL);
             printf("%s", ctime(&mytime));
             // now, call the parallel function
-            hinted_search_parallel(n, hint);
+            ctx->hint_file = hintfile;
+            hinted_search_parallel(ctx, n, hint, (argc < 5) ? NULL : argv[4]);
+            // the latency of the copies, with the lookups that the search made
+            if(replicate) cache_replica_latency(ctx);
+            computed = true;
+        }else if(strcmp(argv[2], "engines") == 0){
+            int pairs = (argc < 4) ? 100000 : atoi(argv[3]);
+            u64 seed = (argc < 5) ? 1 : strtoull(argv[4], NULL, 10);
+            engines_check(ctx, n, pairs, seed);
+            computed = true;
+        }else if(strcmp(argv[2], "autotune") == 0){
+            int blocks = (argc < 4) ? 16 : atoi(argv[3]);
+            hint = (argc < 5) ? 0 : atoi(argv[4]);
+            autotune(ctx, n, blocks, hint, tune);
+            computed = true;
+        }else if(strcmp(argv[2], "oracle") == 0){
+            printf("Table of maxocc for words with %d bits.\n", n);
+            build_oracle(ctx, n, (argc < 4) ? NULL : argv[3]);
+            computed = true;
+        }else if(strcmp(argv[2], "verify") == 0){
+            if(argc < 4){
+                printf("Needs the certificate file.\n");
+            }else{
+                warm_cache(ctx, n);
+                bool replicate = numa_wanted(numa, ctx, n);
+                if(replicate) cache_replicate(ctx);
+                verify_search(ctx, n, argv[3]);
+                if(replicate) cache_replica_latency(ctx);
+            }
             computed = true;
         }else{
            hint = atoi(argv[2]);
@@ -100,13 +252,14 @@ int main(int argc, char** argv){
     if(!computed){
         if(hint == 0){
             printf("Invalid hint. Need an over-estimation of minimal maxocc.\n");
-            printf("Using default hint 2^n.\n");
-            hint = 1;
-            hint <<= n;
+            printf("Searching without a hint.\n");
+            hint = NO_RECORD;
         }
-        hinted_search(n, hint);
+        ctx->hint_file = hintfile;
+        hinted_search(ctx, n, hint);
     }
     mytime = time(NULL);
-    printf("%s", ctime(&mytime)); 
+    fprintf(info, "%s", ctime(&mytime)); 
+    sw_ctx_free(ctx);
     return 0;
 }
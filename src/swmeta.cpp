@@ -20,6 +20,7 @@
 ******************************************************************************/
 
 #include "swmeta.hpp"
+#include <pthread.h>
 
 // initialize combination represented by bits, all on the left
 static inline u64 init_comb(int n, int k){
@@ -46,52 +47,183 @@ static inline bool next_comb(int n, int k, u64* cur){
     return true;
 }
 
-// debug purpose
-void check_comb(int n, int k){
+// debug purpose, the messages go to log (may be NULL)
+void check_comb(int n, int k, FILE* log){
     u64 comb = init_comb(n, k);
     u64 oldcomb = comb;
     u64 cnt = 1;
     while(next_comb(n, k, &comb)) {
         if(oldcomb <= comb){
-            printf("Error at %lu\n", oldcomb);
+            if(log) fprintf(log, "Error at %lu\n", oldcomb);
             break;
         }
         cnt++;
     }
-    printf("n: %d, k: %d, total: %lu\n", n, k, cnt);
+    if(log) fprintf(log, "n: %d, k: %d, total: %lu\n", n, k, cnt);
     return; 
 }
 
+// kinds of bounds stored in the transposition table
+#define TT_LOWER 1
+#define TT_UPPER 2
+
+// key of a word in the transposition table
+static inline u64 tt_key(Word w){
+    return ((u64) w.len << 57) | canonical_bits(w.bits, w.len);
+}
+
+// slot of a key, multiplicative hashing
+static inline Tt_entry* tt_slot(Sw_ctx* ctx, u64 key){
+    return ctx->ttable + ((key * 0x9E3779B97F4A7C15ULL) >> (64 - TT_BITS));
+}
+
+// allocate the transposition table once, the threads (e.g., the workers of
+// the server) that arrive during the allocation wait until it is cleared
+static inline void tt_init(Sw_ctx* ctx){
+    std::call_once(ctx->tt_once, [ctx](){
+        Tt_entry* table = new Tt_entry[1ULL << TT_BITS];
+        for(u64 i = 0; i < (1ULL << TT_BITS); i++){
+            table[i].check.store(0, std::memory_order_relaxed);
+            table[i].data.store(0, std::memory_order_relaxed);
+        }
+        ctx->ttable = table;
+    });
+    return;
+}
+
+// whether w improves on the record, i.e., its fast maxocc is smaller, with the
+// transposition table consulted first and updated after an evaluation
+static inline bool tt_improves(Sw_ctx* ctx, Word w, u64 record){
+    if(w.len > TT_MAXLEN) return maxfreq_subword_hinted_fast_occ(ctx, w, record) < record;
+    u64 key = tt_key(w);
+    Tt_entry* entry = tt_slot(ctx, key);
+    u64 data = entry->data.load(std::memory_order_relaxed);
+    u64 check = entry->check.load(std::memory_order_relaxed);
+    ctx->tt_lookups++;
+    if(data != 0 && (check ^ data) == key){
+        u64 bound = data >> 2;
+        if(((data & TT_LOWER) && bound >= record) || ((data & TT_UPPER) && bound < record)){
+            ctx->tt_hits++;
+            return bound < record;
+        }
+    }
+    u64 occ = maxfreq_subword_hinted_fast_occ(ctx, w, record);
+    // a larger count stops the evaluation early, and a smaller one may skip
+    // lengths, so only an equal count is exact
+    if(occ > record) data = (occ << 2) | TT_LOWER;
+    else if(occ == record) data = (occ << 2) | TT_LOWER | TT_UPPER;
+    else data = ((record - 1) << 2) | TT_UPPER;
+    entry->data.store(data, std::memory_order_relaxed);
+    entry->check.store(key ^ data, std::memory_order_relaxed);
+    return occ < record;
+}
+
+// log the hit rate of the transposition table
+static void log_tt_stats(Sw_ctx* ctx){
+    if(ctx->log == NULL) return;
+    u64 lookups = ctx->tt_lookups;
+    u64 hits = ctx->tt_hits;
+    fprintf(ctx->log, "Transposition table: %lu hits out of %lu lookups (%.1f%%)\n",
+            hits, lookups, lookups ? 100.0 * hits / lookups : 0.0);
+    return;
+}
+
+// scan a neighborhood by chunks, until an improving combination is found
+// before the current chunk; in non-deterministic mode any improving
+// combination cancels all the threads
+static void* local_scan_parallel(void* info){
+    Scan_info sinfo = *((Scan_info*) info);
+    int n = sinfo.w.len;
+    size_t cnt = sinfo.combs->size();
+    bool deterministic = sinfo.ctx->deterministic;
+    while(true){
+        size_t start = (*sinfo.next) += SCAN_CHUNK;
+        start -= SCAN_CHUNK;
+        for(size_t i = start; i < start + SCAN_CHUNK && i < cnt; i++){
+            size_t found = *sinfo.found;
+            if(deterministic ? i > found : found < cnt) goto done;
+            Word curw = build_word(sinfo.w.bits ^ (*sinfo.combs)[i], n);
+            if(tt_improves(sinfo.ctx, curw, sinfo.record)){
+                // keep the smallest one
+                while(i < found && !sinfo.found->compare_exchange_weak(found, i));
+                break;
+            }
+        }
+        if(start >= cnt) break;
+    }
+done:
+    l1_stats_collect(sinfo.ctx);
+    return NULL;
+}
+
+// the same as local_search below, with the scans on several threads
+// in deterministic mode, the combinations before an improving one are never
+// improving with the new record, so the next scan starts just after it, with
+// the same result; otherwise some of them were not scanned
+static Rec_sw local_search_parallel(Sw_ctx* ctx, Word w, int k, u64 record){
+    Rec_sw minrec = {w, std::vector<Word>(), record};
+    int n = w.len;
+    int thread_cnt = ctx->search_threads < THREAD_COUNT ? ctx->search_threads : THREAD_COUNT;
+    Scan_info scan_info;
+    pthread_t thrds[THREAD_COUNT];
+    std::vector<u64> combs;
+    u64 comb = init_comb(n - 1, k);
+    do {
+        combs.push_back(comb);
+    } while(next_comb(n - 1, k, &comb));
+    std::atomic<size_t> next = 0;
+    std::atomic<size_t> found;
+    while(true){
+        found = combs.size();
+        scan_info = {ctx, w, record, &combs, &next, &found};
+        for(int thread_id = 0; thread_id < thread_cnt; thread_id++){
+            pthread_create(thrds + thread_id, NULL, local_scan_parallel, &scan_info);
+        }
+        for(int thread_id = 0; thread_id < thread_cnt; thread_id++){
+            pthread_join(thrds[thread_id], NULL);
+        }
+        if(found == combs.size()) break;
+        Word curw = build_word(w.bits ^ combs[found], n);
+        minrec = maxfreq_subword_hinted_fast(ctx, curw, record);
+        record = minrec.occ;
+        next = ctx->deterministic ? found + 1 : 0;
+    }
+    minrec.word = build_word(minrec.word.bits, n);
+    return minrec;
+}
+
 // search for the whole neighborhood, hinted by record and previous subwords
-static inline Rec_sw local_search(Word w, int k, u64 record){
+static inline Rec_sw local_search(Sw_ctx* ctx, Word w, int k, u64 record){
+    tt_init(ctx);
+    if(ctx->search_threads > 1 && ctx->parallel_mask == 0){
+        return local_search_parallel(ctx, w, k, record);
+    }
     Rec_sw minrec = {w, std::vector<Word>(), record};
     int n = w.len;
-    int tab[MAXLEN];
     bool flag = true;
-    Runtab swruns;
     while(flag) {
         u64 comb = init_comb(n - 1, k);
         u64 recbits = w.bits;
         flag = false;
         do {
-            Word curw = build_word(w.bits ^ comb, n, swruns);
-            Rec_sw maxrec = maxfreq_subword_hinted_fast(curw, record);
-            if(maxrec.occ < minrec.occ){
-                minrec = maxrec;
+            Word curw = build_word(w.bits ^ comb, n);
+            // the full record is only built when we improve
+            if(tt_improves(ctx, curw, record)){
+                minrec = maxfreq_subword_hinted_fast(ctx, curw, record);
                 record = minrec.occ;
                 flag = true;
                 break;
             }
         } while(next_comb(n - 1, k, &comb));
     }
-    minrec.word = build_word(minrec.word.bits, n, swruns);
+    minrec.word = build_word(minrec.word.bits, n);
     return minrec;
 }
 
-static inline Rec_sw local_search_full(Word w, int k, u64 record){
+static inline Rec_sw local_search_full(Sw_ctx* ctx, Word w, int k, u64 record){
     Rec_sw minrec = {w, std::vector<Word>(), record};
     for(int kk = 1; kk <= k; kk++){
-        Rec_sw maxrec = local_search(w, kk, record);
+        Rec_sw maxrec = local_search(ctx, w, kk, record);
         if(maxrec.occ < minrec.occ){
             minrec = maxrec;
             record = minrec.occ;
@@ -101,31 +233,128 @@ static inline Rec_sw local_search_full(Word w, int k, u64 record){
     return minrec;
 }
 
-// generate a random word with given length
-static inline Word random_word(int n){
-    u64 bits = 0;
-    Runtab swruns;
-    for(int i = 0; i < n - 1; i++){
-        bits <<= 1;
-        bits += (rand() >> 5) & 1;
+// local search from a given word, with radius up to maxk
+Rec_sw local_descent(Sw_ctx* ctx, Word w, int maxk){
+    return local_search_full(ctx, w, maxk, maxfreq_subword_fast(ctx, w));
+}
+
+// random word starting with 0 from a seeded generator
+static inline Word random_word_seeded(int n, u64* state){
+    return build_word(random_next(state) & low_mask(n - 1), n);
+}
+
+// log a new record with the time, if the context has a log
+static void log_record(Sw_ctx* ctx, Rec_sw* rec){
+    if(ctx->log == NULL) return;
+    time_t mytime = time(NULL);
+    flockfile(ctx->log); // not mixed with the verified records
+    fprintf(ctx->log, "%s", ctime(&mytime));
+    fprint_record(ctx->log, rec);
+    funlockfile(ctx->log);
+    return;
+}
+
+// verify the queued candidates with the exact maxocc, pruned by the best
+// verified record
+static void* verify_worker(void* info){
+    Verifier* ver = (Verifier*) info;
+    Sw_ctx* vctx = sw_ctx_new(NULL);
+    set_cache_budget(vctx, ver->ctx->cache_budget / VERIFY_THREADS);
+    while(true){
+        pthread_mutex_lock(&ver->lock);
+        while(ver->cnt == 0 && !ver->stop) pthread_cond_wait(&ver->nonempty, &ver->lock);
+        if(ver->cnt == 0) break; // stopped with nothing left
+        Word w = ver->words[ver->head];
+        ver->head = (ver->head + 1) % VERIFY_BACKLOG;
+        ver->cnt--;
+        ver->busy++;
+        u64 record = ver->best.occ;
+        pthread_mutex_unlock(&ver->lock);
+        Rec_sw rec = maxfreq_subword_single(vctx, w, record);
+        pthread_mutex_lock(&ver->lock);
+        ver->busy--;
+        if(rec.occ < ver->best.occ){
+            ver->best = rec;
+            if(ver->ctx->log){
+                flockfile(ver->ctx->log);
+                fprintf(ver->ctx->log, "Verified maxocc %lu: ", rec.occ);
+                fprint_record(ver->ctx->log, &rec);
+                funlockfile(ver->ctx->log);
+            }
+        }
+        if(ver->cnt == 0 && ver->busy == 0) pthread_cond_broadcast(&ver->idle);
+        pthread_mutex_unlock(&ver->lock);
+    }
+    pthread_mutex_unlock(&ver->lock);
+    sw_ctx_free(vctx);
+    return NULL;
+}
+
+// start the verification threads for words with n bits
+static Verifier* verifier_new(Sw_ctx* ctx, int n){
+    Verifier* ver = new Verifier;
+    ver->ctx = ctx;
+    ver->head = 0;
+    ver->cnt = 0;
+    ver->busy = 0;
+    ver->stop = false;
+    ver->best = {build_word(0, n), std::vector<Word>(), NO_RECORD};
+    pthread_mutex_init(&ver->lock, NULL);
+    pthread_cond_init(&ver->nonempty, NULL);
+    pthread_cond_init(&ver->idle, NULL);
+    for(int thread_id = 0; thread_id < VERIFY_THREADS; thread_id++){
+        pthread_create(ver->thrds + thread_id, NULL, verify_worker, ver);
+    }
+    return ver;
+}
+
+// queue a candidate without waiting, dropping the oldest one if full
+static void verifier_submit(Verifier* ver, Word w){
+    pthread_mutex_lock(&ver->lock);
+    if(ver->cnt == VERIFY_BACKLOG){
+        ver->head = (ver->head + 1) % VERIFY_BACKLOG;
+        ver->cnt--;
+    }
+    ver->words[(ver->head + ver->cnt) % VERIFY_BACKLOG] = w;
+    ver->cnt++;
+    pthread_cond_signal(&ver->nonempty);
+    pthread_mutex_unlock(&ver->lock);
+    return;
+}
+
+// wait for the queued candidates, stop the threads and return the best
+// verified record
+static Rec_sw verifier_free(Verifier* ver){
+    pthread_mutex_lock(&ver->lock);
+    while(ver->cnt > 0 || ver->busy > 0) pthread_cond_wait(&ver->idle, &ver->lock);
+    ver->stop = true;
+    pthread_cond_broadcast(&ver->nonempty);
+    pthread_mutex_unlock(&ver->lock);
+    for(int thread_id = 0; thread_id < VERIFY_THREADS; thread_id++){
+        pthread_join(ver->thrds[thread_id], NULL);
     }
-    return build_word(bits, n, swruns);
+    Rec_sw best = ver->best;
+    pthread_mutex_destroy(&ver->lock);
+    pthread_cond_destroy(&ver->nonempty);
+    pthread_cond_destroy(&ver->idle);
+    delete ver;
+    return best;
 }
 
 // metaheuristic, mixing iteratively
-void mixed_descent(int n, int maxk, u64 maxiter){
+Rec_sw mixed_descent(Sw_ctx* ctx, int n, int maxk, u64 maxiter, u64 seed){
     time_t mytime = time(NULL);
-    srand(mytime);
-    printf("Starting with n = %d, maxk = %d, maxiter = %lu, %s",
-           n, maxk, maxiter, ctime(&mytime));
+    u64 state = seed;
+    if(ctx->log) fprintf(ctx->log, "Starting with n = %d, maxk = %d, maxiter = %lu, seed %lu, %s",
+                         n, maxk, maxiter, seed, ctime(&mytime));
     // initial record, dummy hint
-    Word w = random_word(n);
-    Rec_sw currec = local_search_full(w, maxk, maxfreq_subword_fast(w));
+    Word w = random_word_seeded(n, &state);
+    Rec_sw currec = local_descent(ctx, w, maxk);
     Rec_sw bestrec = currec;
-    Runtab swruns;
-    mytime = time(NULL);
-    printf("%s", ctime(&mytime));
-    print_record(&bestrec);
+    log_record(ctx, &bestrec);
+    // the fast maxocc only screens, records are verified in the background
+    Verifier* ver = verifier_new(ctx, n);
+    verifier_submit(ver, bestrec.word);
     // random flips
     int flipcnt = maxk + 2;
     u64 itercnt = 0;
@@ -137,8 +366,9 @@ void mixed_descent(int n, int maxk, u64 maxiter){
             if(itercnt >= maxiter){
                 itercnt = 0;
                 flipcnt++;
-                printf("Current flipcnt: %d\n", flipcnt);
-                if(flipcnt * 3 > n) return;
+                if(ctx->log) fprintf(ctx->log, "Current flipcnt: %d\n", flipcnt);
+                log_tt_stats(ctx);
+                if(flipcnt * 3 > n) return verifier_free(ver);
             }
         } else { // we move, so restart more conservatively
             flipcnt = maxk + 2;
@@ -146,18 +376,111 @@ void mixed_descent(int n, int maxk, u64 maxiter){
         // flip random bits
         u64 bits = bestrec.word.bits;
         for(int i = 0; i < n - 1; i++){
-            if(rand() / (float) RAND_MAX * (n - 1) < flipcnt) bits ^= 1ULL << i;
+            if((random_next(&state) >> 11) * 0x1.0p-53 * (n - 1) < flipcnt) bits ^= 1ULL << i;
         }
-        currec = local_search_full(build_word(bits, n, swruns), 
+        currec = local_search_full(ctx, build_word(bits, n), 
                                    maxk, bestrec.occ);
         if(currec.occ < bestrec.occ){
             bestrec = currec;
-            mytime = time(NULL);
-            printf("%s", ctime(&mytime));
-            print_record(&bestrec);
+            log_record(ctx, &bestrec);
+            verifier_submit(ver, bestrec.word);
             flag = false;
         } else {
             flag = true;
         }
     }
-}
\ No newline at end of file
+}
+
+// default parameters of the engines
+Meta_params meta_params_default(double seconds, u64 seed){
+    Meta_params params;
+    params.seconds = seconds;
+    params.seed = seed;
+    params.temp = 0.02;
+    params.cooling = 0.01;
+    params.tenure = 0; // a fraction of n by default
+    params.trace = NULL;
+    return params;
+}
+
+// CPU time used since start, in seconds
+static inline double cpu_seconds(clock_t start){
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+// keep a new record, in the trace and in the log
+static void meta_record(Sw_ctx* ctx, Meta_params* params, clock_t start, Rec_sw* bestrec, Word w, u64 occ){
+    *bestrec = maxfreq_subword_hinted_fast(ctx, w, occ);
+    if(params->trace) params->trace->push_back({cpu_seconds(start), occ});
+    log_record(ctx, bestrec);
+    return;
+}
+
+// simulated annealing: a worse move by delta is accepted with probability
+// exp(-delta / temp), i.e., if delta <= -temp * log(u) for a uniform u, which
+// is drawn first so that the evaluation is pruned beyond this bound
+Rec_sw simulated_annealing(Sw_ctx* ctx, int n, Meta_params* params){
+    clock_t start = clock();
+    u64 state = params->seed;
+    Word w = random_word_seeded(n, &state);
+    u64 occ = maxfreq_subword_hinted_fast_occ(ctx, w, NO_RECORD);
+    Rec_sw bestrec;
+    meta_record(ctx, params, start, &bestrec, w, occ);
+    double temp0 = params->temp * occ;
+    double elapsed;
+    while((elapsed = cpu_seconds(start)) < params->seconds){
+        double temp = temp0 * pow(params->cooling, elapsed / params->seconds);
+        // flip a random bit, the first letter stays 0
+        Word neww = build_word(w.bits ^ (1ULL << (random_next(&state) % (n - 1))), n);
+        double u = (random_next(&state) >> 11) * 0x1.0p-53 + 0x1.0p-54;
+        u64 bound = occ + (u64) (-temp * log(u));
+        u64 newocc = maxfreq_subword_hinted_fast_occ(ctx, neww, bound);
+        if(newocc > bound) continue;
+        w = neww;
+        occ = newocc;
+        if(occ < bestrec.occ) meta_record(ctx, params, start, &bestrec, w, occ);
+    }
+    return bestrec;
+}
+
+// tabu search with a recency memory: the iteration at which each position was
+// last flipped
+Rec_sw tabu_search(Sw_ctx* ctx, int n, Meta_params* params){
+    clock_t start = clock();
+    u64 state = params->seed;
+    int tenure = params->tenure > 0 ? params->tenure : n / 4 + 1;
+    Word w = random_word_seeded(n, &state);
+    u64 occ = maxfreq_subword_hinted_fast_occ(ctx, w, NO_RECORD);
+    Rec_sw bestrec;
+    meta_record(ctx, params, start, &bestrec, w, occ);
+    u64 flipped[MAXLEN];
+    for(int i = 0; i < n - 1; i++) flipped[i] = 0;
+    u64 iter = 0;
+    while(cpu_seconds(start) < params->seconds){
+        iter++;
+        // best allowed neighbor, pruned by the best one so far; ties are
+        // broken at random to move along plateaus
+        u64 record = NO_RECORD;
+        int bestpos = -1;
+        u64 tiecnt = 0;
+        for(int i = 0; i < n - 1; i++){
+            Word neww = build_word(w.bits ^ (1ULL << i), n);
+            u64 newocc = maxfreq_subword_hinted_fast_occ(ctx, neww, record);
+            bool tabu = flipped[i] && iter - flipped[i] <= (u64) tenure;
+            if(tabu && newocc >= bestrec.occ) continue; // aspiration otherwise
+            if(newocc < record || bestpos < 0){
+                record = newocc;
+                bestpos = i;
+                tiecnt = 1;
+            }else if(newocc == record && random_next(&state) % ++tiecnt == 0){
+                bestpos = i;
+            }
+        }
+        if(bestpos < 0) continue; // all tabu, wait for the tenure to expire
+        w = build_word(w.bits ^ (1ULL << bestpos), n);
+        occ = record;
+        flipped[bestpos] = iter;
+        if(occ < bestrec.occ) meta_record(ctx, params, start, &bestrec, w, occ);
+    }
+    return bestrec;
+}
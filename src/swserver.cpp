@@ -0,0 +1,190 @@
+/******************************************************************************
+
+    swmain - a research tool for minimizing maximal subword occurrences
+    
+    Copyright (C) 2024 Wenjie Fang <fwjmath@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+******************************************************************************/
+
+
+#include "swserver.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// longest query line that we accept
+#define QUERY_LEN 256
+
+// parse a 0-1 string into a word, returns false if it is not valid
+// at most MAXLEN - 1 letters, so that 1 << len is still the largest record
+static bool parse_word(const char* str, Word* w){
+    int len = strlen(str);
+    if(len < 2 || len >= MAXLEN || (int) strspn(str, "01") != len) return false;
+    *w = build_word_str(str);
+    return true;
+}
+
+// answer a single query, written to out as a single line
+static void answer_query(Sw_ctx* ctx, char* query, FILE* out){
+    char str[MAXLEN + 1];
+    char* save;
+    char* cmd = strtok_r(query, " \t\r\n", &save);
+    char* arg = strtok_r(NULL, " \t\r\n", &save);
+    Word w;
+    if(cmd == NULL){
+        fprintf(out, "error empty query\n");
+    }else if(strcmp(cmd, "ping") == 0){
+        fprintf(out, "ok\n");
+    }else if(arg == NULL || !parse_word(arg, &w)){
+        fprintf(out, "error invalid word\n");
+    }else if(strcmp(cmd, "maxocc") == 0){
+        Rec_sw rec = maxfreq_subword_single(ctx, w, NO_RECORD);
+        fprintf(out, "ok %lu", rec.occ);
+        for(auto sw : rec.subwords){
+            word_to_str(sw, str);
+            fprintf(out, " %s", str);
+        }
+        fprintf(out, "\n");
+    }else if(strcmp(cmd, "insert") == 0){
+        if(w.len >= MAXLEN - 1){
+            fprintf(out, "error word too long\n");
+            return;
+        }
+        Word neww;
+        u64 occ = insert_heuristic_word(ctx, w, &neww);
+        word_to_str(neww, str);
+        fprintf(out, "ok %s %lu\n", str, occ);
+    }else if(strcmp(cmd, "local") == 0){
+        char* karg = strtok_r(NULL, " \t\r\n", &save);
+        int k = (karg == NULL) ? 1 : atoi(karg);
+        if(k <= 0 || k >= w.len){
+            fprintf(out, "error invalid radius\n");
+            return;
+        }
+        Rec_sw rec = local_descent(ctx, w, k);
+        word_to_str(rec.word, str);
+        fprintf(out, "ok %s %lu\n", str, rec.occ);
+    }else{
+        fprintf(out, "error unknown query\n");
+    }
+    return;
+}
+
+// serve one client until it closes the connection
+static void serve_client(Sw_ctx* ctx, int fd){
+    int outfd = dup(fd);
+    FILE* in = fdopen(fd, "r");
+    FILE* out = (outfd < 0) ? NULL : fdopen(outfd, "w");
+    if(in == NULL || out == NULL){
+        if(in != NULL) fclose(in); else close(fd);
+        if(out != NULL) fclose(out); else if(outfd >= 0) close(outfd);
+        return;
+    }
+    char query[QUERY_LEN];
+    while(fgets(query, sizeof(query), in) != NULL){
+        // a longer line is drained, and answered once
+        if(strchr(query, '\n') == NULL && !feof(in)){
+            int c;
+            while((c = fgetc(in)) != EOF && c != '\n');
+            fprintf(out, "error query too long\n");
+            if(fflush(out) != 0) break;
+            continue;
+        }
+        if(strncmp(query, "quit", 4) == 0) break;
+        answer_query(ctx, query, out);
+        if(fflush(out) != 0) break; // client gone
+    }
+    fclose(out);
+    fclose(in);
+    return;
+}
+
+// worker of the pool, takes connections from the queue
+static void* server_worker(void* info){
+    Server_info sinfo = *((Server_info*) info);
+    Conn_queue* queue = sinfo.queue;
+    while(true){
+        pthread_mutex_lock(&queue->lock);
+        while(queue->cnt == 0) pthread_cond_wait(&queue->nonempty, &queue->lock);
+        int fd = queue->fds[queue->head];
+        queue->head = (queue->head + 1) % SERVER_BACKLOG;
+        queue->cnt--;
+        pthread_mutex_unlock(&queue->lock);
+        serve_client(sinfo.ctx, fd);
+    }
+    return NULL;
+}
+
+// answer queries on a Unix domain socket, with the context kept in memory
+void serve_queries(Sw_ctx* ctx, const char* path){
+    struct sockaddr_un addr;
+    if(strlen(path) >= sizeof(addr.sun_path)){
+        printf("Socket path too long: %s\n", path);
+        return;
+    }
+    // writing to a client that has left should not kill the server
+    signal(SIGPIPE, SIG_IGN);
+    // the queries count through the subwords directly and do not read the
+    // cache, which is only frozen so that the workers never write it
+    set_parallel_mode(ctx);
+    // open the socket
+    int sfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(sfd < 0){
+        printf("Cannot create socket\n");
+        return;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path); // stale socket from a previous run
+    if(bind(sfd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+       || listen(sfd, SERVER_BACKLOG) < 0){
+        printf("Cannot listen on %s\n", path);
+        close(sfd);
+        return;
+    }
+    // the pool of workers
+    Conn_queue queue;
+    queue.head = 0;
+    queue.cnt = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.nonempty, NULL);
+    Server_info sinfo = {ctx, &queue};
+    pthread_t thrds[THREAD_COUNT];
+    for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+        pthread_create(thrds + thread_id, NULL, server_worker, &sinfo);
+    }
+    printf("Listening on %s\n", path);
+    fflush(stdout);
+    // accept connections and give them to the workers
+    while(true){
+        int cfd = accept(sfd, NULL, NULL);
+        if(cfd < 0) continue;
+        pthread_mutex_lock(&queue.lock);
+        if(queue.cnt == SERVER_BACKLOG){ // too many waiting clients
+            pthread_mutex_unlock(&queue.lock);
+            close(cfd);
+            continue;
+        }
+        queue.fds[(queue.head + queue.cnt) % SERVER_BACKLOG] = cfd;
+        queue.cnt++;
+        pthread_cond_signal(&queue.nonempty);
+        pthread_mutex_unlock(&queue.lock);
+    }
+}
@@ -20,9 +20,11 @@
 ******************************************************************************/
 
 #include "swutils.hpp"
+#include <algorithm>
+#include <string>
 
 // build a word according to a 0-1 string
-Word build_word_str(const char* str, Runtab wruns){
+Word build_word_str(const char* str){
     int n = strlen(str);
     u64 bits = 0;
     // assuming 0-1 string
@@ -30,100 +32,49 @@ Word build_word_str(const char* str, Runtab wruns){
         bits <<= 1;
         bits += str[i] - '0';
     }
-    return build_word(bits, n, wruns);
+    return build_word(bits, n);
 }
 
-// print record
-void print_record(Rec_sw* minrec){
-    print_word_bin(minrec->word);
+// print record to a given file
+void fprint_record(FILE* out, Rec_sw* minrec){
+    char str[MAXLEN + 1];
+    word_to_str(minrec->word, str);
+    fprintf(out, "%s\n", str);
     for(auto sw : minrec->subwords){
-        printf("Subword: ");
-        print_word_bin(sw);
+        word_to_str(sw, str);
+        fprintf(out, "Subword: %s\n", str);
     }
     return;
 }
 
-// exhaustive search for minimal subword entropy, using a hint
-// using subword with large number of occurrences from the last word as a hint
-void hinted_search(int n, u64 hint){
-    Rec_occ minrec = min_maxfreq_subword_hinted(n, hint);
-    printf("%d bits, hint %lu, found %lu\n", n, hint, minrec.occ);
-    for(auto rec : minrec.recs){
-        print_record(&rec);
-    }
-    return;
-}
-
-// exhaustive search for minimal subword entropy, using a hint, parallel version
-void hinted_search_parallel(int n, u64 hint){
-    Rec_occ minrecs[THREAD_COUNT];
-    Thread_info thread_info[THREAD_COUNT];
-    pthread_t thrds[THREAD_COUNT];
-    if(thrds == NULL){
-        printf("Parallelization failed at initialization\n");
+// fill the cache for words with n bits, before freezing it in parallel mode
+void warm_cache(Sw_ctx* ctx, int n){
+    // nothing would read it, all the counts go to the run DP
+    if(!cache_engine_used(ctx, n)){
+        if(ctx->log) fprintf(ctx->log, "Warm-up skipped, the cache is not used with %d bits\n", n);
         return;
     }
-    // set parallel mode, freeze the cache
-    set_parallel_mode();
-    // create threads
-    for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
-        thread_info[thread_id].n = n;
-        thread_info[thread_id].thread_id = thread_id;
-        thread_info[thread_id].record = hint;
-        thread_info[thread_id].minrec = minrecs + thread_id;
-        pthread_create(thrds + thread_id, NULL, min_maxfreq_subword_hinted_parallel, thread_info + thread_id);
-    }
-    // collect all threads
-    for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
-        pthread_join(thrds[thread_id], NULL);
-    }
-    // get the best record
-    u64 minocc = minrecs[0].occ;
-    for(int i = 0; i < THREAD_COUNT; i++){
-        if(minocc > minrecs[i].occ){
-            minocc = minrecs[i].occ;
-        }
-    }
-    printf("%d bits, hint %lu, found %lu\n", n, hint, minocc);
-    for(int i = 0; i < THREAD_COUNT; i++){
-        if(minrecs[i].occ != minocc) continue;
-        for(auto rec : minrecs[i].recs){
-            print_record(&rec);
-        }
-    }
-    return;
-}
-
-// build a histogram for subword occurrences
-void histo_subword(int n){
-    Histogram histo = maxfreq_subword_histo(n);
-    printf("Maximal subword occurrences histogram for %d bits\n{\n", n);
-    for(const auto& [freq, cnt] : histo){
-        printf("%lu: %lu\n", freq, cnt);
-    }
-    printf("}\n");
-    return;
-}
-
-// compute the most frequent subwords of a given word
-void compute_maxfreq_subword(char* wstr){
-    int n = strlen(wstr);
-    Runtab wruns;
-    Rec_sw minrec = maxfreq_subword_single(build_word_str(wstr, wruns), 1ul << n);
-    printf("Word %s, maxocc %lu\n", wstr, minrec.occ);
-    print_record(&minrec);
+    // fill the cache with the pairs the search may ask for
+    // all pairs are there, so shorter pieces suffice than with a histogram pass
+    // only the pairs with little slack go to the recursion, and longer pieces
+    // cost more to fill than they save (n = 24: 12 letters take 15% longer)
+    int cachebit = std::max(2, (n >> 1) - 3);
+    if(cachebit > 18) cachebit = 18; // takes 10GB memory without a budget
+    if(ctx->warm_maxlen > 0) cachebit = ctx->warm_maxlen; // from a profile
+    warm_cache_pairs(ctx, cachebit);
+    // the statistics of the first-level caches are those of the searches
+    ctx->l1_lookups = 0;
+    ctx->l1_hits = 0;
     return;
 }
 
 // adds a letter somewhere in a hinted word (previous record), using incomplete
-// computation
-void insert_heuristic(char* wstr){
-    int n = strlen(wstr);
-    Runtab wruns;
-    Word oldw = build_word_str(wstr, wruns);
+// computation. Returns the fast maxocc, and the new word in neww
+u64 insert_heuristic_word(Sw_ctx* ctx, Word oldw, Word* neww){
+    int n = oldw.len;
     u64 wbits = oldw.bits;
     u64 recw = wbits;
-    u64 recocc = maxfreq_subword_fast(oldw) << 1;
+    u64 recocc = maxfreq_subword_fast(ctx, oldw) << 1;
     // insert a new bit at each possible way
     for(int i = 0; i < n; i++){
         for(int bit = 0; bit < 2; bit++){
@@ -133,16 +84,171 @@ void insert_heuristic(char* wstr){
             newbits += bit;
             newbits <<= i;
             newbits += wbits & ((1ul << i) - 1);
-            Word w = build_word(newbits, n + 1, wruns);
-            u64 swocc = maxfreq_subword_fast(w);
+            Word w = build_word(newbits, n + 1);
+            u64 swocc = maxfreq_subword_fast(ctx, w);
             if(swocc < recocc){
                 recocc = swocc;
                 recw = newbits;
             }
         }
     }
-    oldw = build_word(recw, n + 1, wruns);
-    print_word_bin(oldw);
-    printf("Maxocc (fast): %lu\n", recocc);
+    *neww = build_word(recw, n + 1);
+    return recocc;
+}
+
+// evaluate the candidates of a round, with the beam-th best maxocc so far as
+// the record: the pruned words are not kept anyway
+static void* insert_beam_parallel(void* info){
+    Beam_info binfo = *((Beam_info*) info);
+    while(true){
+        size_t i = (*binfo.next)++;
+        if(i >= binfo.cands->size()) break;
+        Word w = (*binfo.cands)[i];
+        pthread_mutex_lock(binfo.lock);
+        u64 record = ((int) binfo.best->size() < binfo.beam) ? NO_RECORD : binfo.best->top();
+        pthread_mutex_unlock(binfo.lock);
+        u64 occ = maxfreq_subword_single(binfo.ctx, w, record).occ;
+        binfo.occs[i] = occ;
+        pthread_mutex_lock(binfo.lock);
+        if((int) binfo.best->size() < binfo.beam){
+            binfo.best->push(occ);
+        }else if(occ < binfo.best->top()){
+            binfo.best->pop();
+            binfo.best->push(occ);
+        }
+        pthread_mutex_unlock(binfo.lock);
+    }
+    l1_stats_collect(binfo.ctx);
+    return NULL;
+}
+
+// beam search by insertions, the words of a round all have the same length
+std::vector<Rec_sw> insert_beam(Sw_ctx* ctx, std::vector<Word> parents, int rounds, int beam){
+    std::vector<Word> words = parents;
+    std::vector<Rec_sw> recs;
+    Beam_info beam_info;
+    pthread_t thrds[THREAD_COUNT];
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    for(int round = 0; round < rounds; round++){
+        int n = words[0].len + 1;
+        // all the insertions, once per class
+        std::vector<u64> bitlist;
+        for(Word w : words){
+            for(int i = 0; i < n; i++){
+                for(u64 bit = 0; bit < 2; bit++){
+                    u64 newbits = ((w.bits >> i) << (i + 1)) | (bit << i) | (w.bits & low_mask(i));
+                    bitlist.push_back(canonical_bits(newbits, n));
+                }
+            }
+        }
+        std::sort(bitlist.begin(), bitlist.end());
+        bitlist.erase(std::unique(bitlist.begin(), bitlist.end()), bitlist.end());
+        std::vector<Word> cands;
+        for(u64 bits : bitlist) cands.push_back(build_word(bits, n));
+        // exact evaluation on the frozen cache
+        warm_cache(ctx, n);
+        set_parallel_mode(ctx);
+        u64* occs = new u64[cands.size()];
+        std::atomic<size_t> next = 0;
+        std::priority_queue<u64> best;
+        beam_info = {ctx, &cands, occs, &next, &best, beam, &lock};
+        for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+            pthread_create(thrds + thread_id, NULL, insert_beam_parallel, &beam_info);
+        }
+        for(int thread_id = 0; thread_id < THREAD_COUNT; thread_id++){
+            pthread_join(thrds[thread_id], NULL);
+        }
+        // keep the best ones, ties broken by the bits
+        std::vector<size_t> order(cands.size());
+        for(size_t i = 0; i < cands.size(); i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b){
+            return occs[a] != occs[b] ? occs[a] < occs[b] : a < b;
+        });
+        if(order.size() > (size_t) beam) order.resize(beam);
+        words.clear();
+        for(size_t i : order) words.push_back(cands[i]);
+        if(ctx->log){
+            fprintf(ctx->log, "Round %d: %zu candidates with %d bits, best maxocc %lu\n",
+                    round + 1, cands.size(), n, occs[order[0]]);
+            fflush(ctx->log);
+        }
+        delete[] occs;
+    }
+    // the full records of the last beam, already in order
+    for(Word w : words) recs.push_back(maxfreq_subword_single(ctx, w, NO_RECORD));
+    return recs;
+}
+
+// the parameters that a profile may set, returns their number
+int tune_params(Sw_ctx* ctx, Tune_param* params){
+    int cnt = 0;
+    params[cnt++] = {"max_cache_run", &ctx->max_cache_run};
+    params[cnt++] = {"insert_margin", &ctx->insert_margin};
+    params[cnt++] = {"warm_maxlen", &ctx->warm_maxlen};
+    params[cnt++] = {"bitdp_maxlen", &ctx->bitdp_maxlen};
+    params[cnt++] = {"rundp_slackpct", &ctx->rundp_slackpct};
+    return cnt;
+}
+
+// write the parameters as pairs, in the format of the profiles
+void fprint_tuning(FILE* out, Sw_ctx* ctx){
+    Tune_param params[16];
+    int cnt = tune_params(ctx, params);
+    for(int i = 0; i < cnt; i++){
+        fprintf(out, "%s%s %d", i ? " " : "", params[i].name, *params[i].value);
+    }
     return;
 }
+
+// load the profile for n, unknown names are ignored
+bool load_tuning(Sw_ctx* ctx, int n, const char* path){
+    FILE* in = fopen(path, "r");
+    if(in == NULL) return false;
+    Tune_param params[16];
+    int cnt = tune_params(ctx, params);
+    char line[1024];
+    bool found = false;
+    while(!found && fgets(line, sizeof(line), in) != NULL){
+        char* save;
+        char* name = strtok_r(line, " \t\r\n", &save);
+        char* value = strtok_r(NULL, " \t\r\n", &save);
+        if(name == NULL || value == NULL || strcmp(name, "n") != 0 || atoi(value) != n) continue;
+        found = true;
+        while((name = strtok_r(NULL, " \t\r\n", &save)) != NULL
+              && (value = strtok_r(NULL, " \t\r\n", &save)) != NULL){
+            for(int i = 0; i < cnt; i++){
+                if(strcmp(name, params[i].name) == 0) *params[i].value = atoi(value);
+            }
+        }
+    }
+    fclose(in);
+    if(found && ctx->log){
+        fprintf(ctx->log, "Tuning profile for %d bits: ", n);
+        fprint_tuning(ctx->log, ctx);
+        fprintf(ctx->log, "\n");
+    }
+    return found;
+}
+
+// replace the profile for n in the file, the others are kept
+bool save_tuning(Sw_ctx* ctx, int n, const char* path){
+    std::vector<std::string> lines;
+    char line[1024];
+    FILE* in = fopen(path, "r");
+    if(in != NULL){
+        while(fgets(line, sizeof(line), in) != NULL){
+            int m;
+            if(sscanf(line, "n %d", &m) == 1 && m == n) continue;
+            lines.push_back(line);
+        }
+        fclose(in);
+    }
+    FILE* out = fopen(path, "w");
+    if(out == NULL) return false;
+    for(auto& l : lines) fputs(l.c_str(), out);
+    fprintf(out, "n %d ", n);
+    fprint_tuning(out, ctx);
+    fprintf(out, "\n");
+    fclose(out);
+    return true;
+}